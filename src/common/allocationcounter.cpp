@@ -0,0 +1,66 @@
+#include "allocationcounter.h"
+#include "common/config.h"
+
+#include <cstdlib>
+#include <new>
+
+#ifdef ENABLE_ALLOCATION_COUNTER
+
+static thread_local uint64_t numAllocations = 0;
+
+
+void *
+operator new(std::size_t size)
+{
+    numAllocations++;
+    void * p = std::malloc(size == 0 ? 1 : size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+
+void *
+operator new[](std::size_t size)
+{
+    return ::operator new(size);
+}
+
+
+void
+operator delete(void * p) noexcept
+{
+    std::free(p);
+}
+
+
+void
+operator delete[](void * p) noexcept
+{
+    std::free(p);
+}
+
+#endif
+
+
+bool
+AllocationCounter::isEnabled()
+{
+#ifdef ENABLE_ALLOCATION_COUNTER
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+uint64_t
+AllocationCounter::get()
+{
+#ifdef ENABLE_ALLOCATION_COUNTER
+    return numAllocations;
+#else
+    return 0;
+#endif
+}
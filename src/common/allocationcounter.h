@@ -0,0 +1,28 @@
+#ifndef __common_allocationcounter_h__
+#define __common_allocationcounter_h__
+
+#include <cstdint>
+
+/**
+ * counts the heap allocations of each thread to measure the allocations
+ * per feature.
+ *
+ * The counting replaces the global operator new and is only compiled in
+ * when batyr is build with ENABLE_ALLOCATION_COUNTER.
+ */
+namespace AllocationCounter
+{
+    /**
+     * check if batyr was build with the allocation counter
+     */
+    bool isEnabled();
+
+    /**
+     * number of allocations of the calling thread. Always 0 when the
+     * counter is not enabled.
+     */
+    uint64_t get();
+
+};
+
+#endif /* __common_allocationcounter_h__ */
@@ -2,6 +2,7 @@
 #define __common_nullablevalue_h__
 
 #include <string>
+#include <utility>
 
 /**
  * A value which may contain an actual value or may be null
@@ -29,9 +30,26 @@ class NullableValue
             return value;
         }
 
+        /**
+         * access the value without copying it
+         */
+        const T & getRef() const
+        {
+            return value;
+        }
+
+        /**
+         * modify the value in place. This allows reusing the storage
+         * of the previous value.
+         */
+        T & getMutable()
+        {
+            return value;
+        }
+
         void set(T _value)
         {
-            value = _value;
+            value = std::move(_value);
         };
 
         void setIsNull(bool _is_null)
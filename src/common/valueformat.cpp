@@ -0,0 +1,164 @@
+#include "valueformat.h"
+
+#include <clocale>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+
+/**
+ * append the value zero-padded to the given width
+ */
+static void
+appendPadded(std::string &out, int value, int width)
+{
+    char digits[16];
+    int numDigits = 0;
+
+    unsigned int uvalue = static_cast<unsigned int>(value);
+    if (value < 0) {
+        out.push_back('-');
+        uvalue = 0u - uvalue;
+        width--;
+    }
+    do {
+        digits[numDigits++] = '0' + (uvalue % 10);
+        uvalue /= 10;
+    } while (uvalue > 0);
+
+    for (int i=numDigits; i<width; i++) {
+        out.push_back('0');
+    }
+    while (numDigits > 0) {
+        out.push_back(digits[--numDigits]);
+    }
+}
+
+
+void
+ValueFormat::appendInteger(std::string &out, long long value)
+{
+    char digits[24];
+    int numDigits = 0;
+
+    // negate as unsigned to handle the min. value
+    unsigned long long uvalue = static_cast<unsigned long long>(value);
+    if (value < 0) {
+        out.push_back('-');
+        uvalue = 0ull - uvalue;
+    }
+    do {
+        digits[numDigits++] = '0' + (uvalue % 10);
+        uvalue /= 10;
+    } while (uvalue > 0);
+
+    while (numDigits > 0) {
+        out.push_back(digits[--numDigits]);
+    }
+}
+
+
+void
+ValueFormat::appendDouble(std::string &out, double value)
+{
+    if (std::isnan(value)) {
+        out.append("NaN");
+        return;
+    }
+    if (std::isinf(value)) {
+        out.append(value < 0 ? "-Infinity" : "Infinity");
+        return;
+    }
+
+    // 17 significant digits are always sufficient to restore a double,
+    // but most values have a shorter exact representation.
+    char buf[32];
+    int length = 0;
+    for (int precision=15; precision<=17; precision++) {
+        length = std::snprintf(buf, sizeof(buf), "%.*g", precision, value);
+        if ((precision == 17) || (std::strtod(buf, nullptr) == value)) {
+            break;
+        }
+    }
+
+    // snprintf and strtod use the decimal point of the current locale
+    const char decimalPoint = *std::localeconv()->decimal_point;
+    for (int i=0; i<length; i++) {
+        if (buf[i] == decimalPoint) {
+            buf[i] = '.';
+            break;
+        }
+    }
+    out.append(buf, length);
+}
+
+
+void
+ValueFormat::appendDate(std::string &out, int year, int month, int day)
+{
+    appendPadded(out, year, 4);
+    out.push_back('-');
+    appendPadded(out, month, 2);
+    out.push_back('-');
+    appendPadded(out, day, 2);
+}
+
+
+void
+ValueFormat::appendTime(std::string &out, int hour, int minute, int second)
+{
+    appendPadded(out, hour, 2);
+    out.push_back(':');
+    appendPadded(out, minute, 2);
+    out.push_back(':');
+    appendPadded(out, second, 9);
+    out.append(".0");
+}
+
+
+void
+ValueFormat::appendTimestamp(std::string &out, int year, int month, int day,
+            int hour, int minute, int second)
+{
+    appendDate(out, year, month, day);
+    out.push_back('T');
+    appendTime(out, hour, minute, second);
+}
+
+
+void
+ValueFormat::appendDoubleArray(std::string &out, const double * values, int numValues)
+{
+    out.push_back('{');
+    for (int i=0; i<numValues; i++) {
+        if (i>0) {
+            out.push_back(',');
+        }
+        appendDouble(out, values[i]);
+    }
+    out.push_back('}');
+}
+
+
+void
+ValueFormat::appendTextArray(std::string &out, const char * const * values, int numValues)
+{
+    out.push_back('{');
+    for (int i=0; i<numValues; i++) {
+        if (i>0) {
+            out.push_back(',');
+        }
+
+        // escape backslash and quotes in the string with a backslash to 
+        // build a valid array
+        out.push_back('"');
+        for (const char * c = values[i]; *c != '\0'; c++) {
+            if ((*c == '\\') || (*c == '"')) {
+                out.push_back('\\');
+            }
+            out.push_back(*c);
+        }
+        out.push_back('"');
+    }
+    out.push_back('}');
+}
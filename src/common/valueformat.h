@@ -0,0 +1,54 @@
+#ifndef __common_valueformat_h__
+#define __common_valueformat_h__
+
+#include <string>
+
+/**
+ * formatting of values in the text representation accepted by the
+ * input functions of postgresql.
+ *
+ * All functions append to the given string, so a string can be reused
+ * as a buffer for many values. The output does not depend on the
+ * locale.
+ */
+namespace ValueFormat
+{
+    void appendInteger(std::string &out, long long value);
+
+    /**
+     * append the shortest representation of the value which parses back
+     * to exactly the same double.
+     */
+    void appendDouble(std::string &out, double value);
+
+    void appendDate(std::string &out, int year, int month, int day);
+    void appendTime(std::string &out, int hour, int minute, int second);
+    void appendTimestamp(std::string &out, int year, int month, int day,
+                int hour, int minute, int second);
+
+    /**
+     * array literals like {1,2,3}
+     */
+    template <typename T>
+    void appendIntegerArray(std::string &out, const T * values, int numValues)
+    {
+        out.push_back('{');
+        for (int i=0; i<numValues; i++) {
+            if (i>0) {
+                out.push_back(',');
+            }
+            appendInteger(out, static_cast<long long>(values[i]));
+        }
+        out.push_back('}');
+    }
+
+    void appendDoubleArray(std::string &out, const double * values, int numValues);
+
+    /**
+     * array literal of quoted strings with backslashes and quotes escaped
+     */
+    void appendTextArray(std::string &out, const char * const * values, int numValues);
+
+};
+
+#endif /* __common_valueformat_h__ */
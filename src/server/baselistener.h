@@ -5,6 +5,9 @@
 
 #include "server/jobstorage.h"
 #include "server/configuration.h"
+#include "server/db/connectionpool.h"
+#include "server/db/metadatacache.h"
+#include "server/db/asyncexecutor.h"
 
 #include <memory>
 
@@ -17,6 +20,9 @@ namespace Batyr {
 
         protected:
             std::weak_ptr<JobStorage> jobs;
+            std::weak_ptr<Db::ConnectionPool> dbPool;
+            std::weak_ptr<Db::MetadataCache> metadataCache;
+            std::weak_ptr<Db::AsyncExecutor> asyncExecutor;
             Configuration::Ptr configuration;
 
         public:
@@ -34,6 +40,21 @@ namespace Batyr {
                 jobs = _jobs;
             }
 
+            void setDbPool(std::shared_ptr<Db::ConnectionPool> _dbPool)
+            {
+                dbPool = _dbPool;
+            }
+
+            void setMetadataCache(std::shared_ptr<Db::MetadataCache> _metadataCache)
+            {
+                metadataCache = _metadataCache;
+            }
+
+            void setAsyncExecutor(std::shared_ptr<Db::AsyncExecutor> _asyncExecutor)
+            {
+                asyncExecutor = _asyncExecutor;
+            }
+
             /**
              * indicates if the run method of the listener
              * will not imediately return and if the listener
@@ -0,0 +1,307 @@
+#include <cmath>
+#include <limits>
+
+#include "server/binarycopyencoder.h"
+#include "server/worker.h"
+
+
+using namespace Batyr;
+namespace TypeOid = Batyr::Db::TypeOid;
+
+
+BinaryCopyEncoder::BinaryCopyEncoder(const ColumnPlan & _columnPlan)
+    :   columnPlan(_columnPlan),
+        columns(_columnPlan.getColumns()),
+        wkbSize(0)
+{
+}
+
+
+bool
+BinaryCopyEncoder::supports(OGRFieldType fieldType, Oid pgTypeOid)
+{
+    switch (fieldType) {
+        case OFTInteger:
+#if GDAL_VERSION_MAJOR > 1
+        case OFTInteger64:
+#endif
+            return (pgTypeOid == TypeOid::INT2) || (pgTypeOid == TypeOid::INT4) || (pgTypeOid == TypeOid::INT8)
+                || (pgTypeOid == TypeOid::FLOAT4) || (pgTypeOid == TypeOid::FLOAT8);
+        case OFTReal:
+            return (pgTypeOid == TypeOid::FLOAT4) || (pgTypeOid == TypeOid::FLOAT8)
+                || (pgTypeOid == TypeOid::INT2) || (pgTypeOid == TypeOid::INT4) || (pgTypeOid == TypeOid::INT8);
+        case OFTString:
+            return (pgTypeOid == TypeOid::TEXT) || (pgTypeOid == TypeOid::VARCHAR) || (pgTypeOid == TypeOid::BPCHAR);
+        case OFTDate:
+            return (pgTypeOid == TypeOid::DATE) || (pgTypeOid == TypeOid::TIMESTAMP);
+        case OFTTime:
+            return (pgTypeOid == TypeOid::TIME);
+        case OFTDateTime:
+            return (pgTypeOid == TypeOid::TIMESTAMP);
+        case OFTIntegerList:
+            return (pgTypeOid == TypeOid::INT4_ARRAY) || (pgTypeOid == TypeOid::INT8_ARRAY);
+#if GDAL_VERSION_MAJOR > 1
+        case OFTInteger64List:
+            return (pgTypeOid == TypeOid::INT8_ARRAY);
+#endif
+        case OFTRealList:
+            return (pgTypeOid == TypeOid::FLOAT8_ARRAY);
+        case OFTStringList:
+            return (pgTypeOid == TypeOid::TEXT_ARRAY) || (pgTypeOid == TypeOid::VARCHAR_ARRAY);
+        case OFTBinary:
+            return (pgTypeOid == TypeOid::BYTEA);
+        default:
+            return false;
+    }
+}
+
+
+bool
+BinaryCopyEncoder::supportsFid(Oid pgTypeOid)
+{
+    return (pgTypeOid == TypeOid::INT4) || (pgTypeOid == TypeOid::INT8);
+}
+
+
+bool
+BinaryCopyEncoder::supports(const ColumnPlan & columnPlan)
+{
+    for (const auto & column : columnPlan.getColumns()) {
+        switch (column.source) {
+            case ColumnPlan::SOURCE_FID:
+                if (!supportsFid(column.pgTypeOid)) {
+                    return false;
+                }
+                break;
+            case ColumnPlan::SOURCE_FIELD:
+                if (!supports(column.fieldType, column.pgTypeOid)) {
+                    return false;
+                }
+                break;
+            case ColumnPlan::SOURCE_GEOMETRY:
+            case ColumnPlan::SOURCE_DIGEST:
+                break;
+        }
+    }
+    return true;
+}
+
+
+void
+BinaryCopyEncoder::writeHeader(Db::CopyStream & copyStream)
+{
+    tuple.clear();
+    tuple.writeHeader();
+    copyStream.write(tuple.data(), tuple.size());
+}
+
+
+void
+BinaryCopyEncoder::writeTrailer(Db::CopyStream & copyStream)
+{
+    tuple.clear();
+    tuple.writeTrailer();
+    copyStream.write(tuple.data(), tuple.size());
+}
+
+
+void
+BinaryCopyEncoder::writeFeature(OGRFeature * ogrFeature, Db::CopyStream & copyStream)
+{
+    wkbSize = ColumnPlan::exportGeometryToWkb(ogrFeature, wkbBuffer);
+
+    // the digest is computed from the same text representation of the values
+    // the other staging methods use, so it does not depend on the staging method
+    int64_t digest = 0;
+    if (columnPlan.getDigestIdx() >= 0) {
+        columnPlan.convertFeature(ogrFeature, digestValues);
+        digest = columnPlan.getDigest(digestValues, wkbBuffer.data(), wkbSize);
+    }
+
+    tuple.clear();
+    tuple.beginTuple(static_cast<int16_t>(columns.size()));
+
+    for (const auto & column : columns) {
+        switch (column.source) {
+            case ColumnPlan::SOURCE_GEOMETRY:
+                writeGeometry();
+                break;
+            case ColumnPlan::SOURCE_DIGEST:
+                tuple.writeInt8(digest);
+                break;
+            case ColumnPlan::SOURCE_FID:
+                writeInteger(column, ogrFeature->GetFID());
+                break;
+            case ColumnPlan::SOURCE_FIELD:
+                writeField(ogrFeature, column);
+                break;
+        }
+    }
+    copyStream.write(tuple.data(), tuple.size());
+}
+
+
+void
+BinaryCopyEncoder::writeInteger(const Column & column, GIntBig value)
+{
+    switch (column.pgTypeOid) {
+        case TypeOid::INT2:
+            if ((value < std::numeric_limits<int16_t>::min()) || (value > std::numeric_limits<int16_t>::max())) {
+                throw WorkerError("Value " + std::to_string(value) + " is out of range for the smallint column \"" + column.name + "\"");
+            }
+            tuple.writeInt2(static_cast<int16_t>(value));
+            break;
+        case TypeOid::INT4:
+            if ((value < std::numeric_limits<int32_t>::min()) || (value > std::numeric_limits<int32_t>::max())) {
+                throw WorkerError("Value " + std::to_string(value) + " is out of range for the integer column \"" + column.name + "\"");
+            }
+            tuple.writeInt4(static_cast<int32_t>(value));
+            break;
+        case TypeOid::INT8:
+            tuple.writeInt8(value);
+            break;
+        case TypeOid::FLOAT4:
+            tuple.writeFloat4(static_cast<float>(value));
+            break;
+        case TypeOid::FLOAT8:
+            tuple.writeFloat8(static_cast<double>(value));
+            break;
+        default:
+            throw WorkerError("Unsupported type for the integer column \"" + column.name + "\"");
+    }
+}
+
+
+void
+BinaryCopyEncoder::writeField(OGRFeature * ogrFeature, const Column & column)
+{
+    const int fieldIdx = column.fieldIdx;
+
+    if (ogrFeature->IsFieldSet(fieldIdx) == 0) {
+        tuple.writeNull();
+        return;
+    }
+
+    switch (column.fieldType) {
+        case OFTInteger:
+            writeInteger(column, ogrFeature->GetFieldAsInteger(fieldIdx));
+            break;
+#if GDAL_VERSION_MAJOR > 1
+        case OFTInteger64:
+            writeInteger(column, ogrFeature->GetFieldAsInteger64(fieldIdx));
+            break;
+#endif
+        case OFTReal:
+            {
+                double value = ogrFeature->GetFieldAsDouble(fieldIdx);
+                if (column.pgTypeOid == TypeOid::FLOAT8) {
+                    tuple.writeFloat8(value);
+                }
+                else if (column.pgTypeOid == TypeOid::FLOAT4) {
+                    tuple.writeFloat4(static_cast<float>(value));
+                }
+                else {
+                    // round like postgresql does when casting double precision
+                    // to an integer type
+                    double rounded = std::rint(value);
+                    if (!(std::fabs(rounded) < 9.2233720368547758e18)) {
+                        throw WorkerError("Value " + std::to_string(value) + " is out of range for the column \"" + column.name + "\"");
+                    }
+                    writeInteger(column, static_cast<GIntBig>(rounded));
+                }
+            }
+            break;
+        case OFTString:
+            {
+                const char * value = ogrFeature->GetFieldAsString(fieldIdx);
+                tuple.writeBytes(value, std::strlen(value));
+            }
+            break;
+        case OFTDate:
+        case OFTTime:
+        case OFTDateTime:
+            {
+                int dtYear = 0;
+                int dtMonth = 0;
+                int dtDay = 0;
+                int dtHour = 0;
+                int dtMinute = 0;
+                int dtSecond = 0;
+                int dtTZFlag = 0;
+
+                if (!ogrFeature->GetFieldAsDateTime(fieldIdx, &dtYear, &dtMonth, &dtDay,
+                            &dtHour, &dtMinute, &dtSecond, &dtTZFlag)) {
+                    tuple.writeNull();
+                }
+                else if (column.pgTypeOid == TypeOid::DATE) {
+                    tuple.writeDate(dtYear, dtMonth, dtDay);
+                }
+                else if (column.pgTypeOid == TypeOid::TIME) {
+                    tuple.writeTime(dtHour, dtMinute, dtSecond);
+                }
+                else {
+                    tuple.writeTimestamp(dtYear, dtMonth, dtDay, dtHour, dtMinute, dtSecond);
+                }
+            }
+            break;
+        case OFTIntegerList:
+            {
+                int listLen = 0;
+                const int *listValues = ogrFeature->GetFieldAsIntegerList(fieldIdx, &listLen);
+                if (column.pgTypeOid == TypeOid::INT8_ARRAY) {
+                    tuple.writeInt8Array(listValues, listLen);
+                }
+                else {
+                    tuple.writeInt4Array(listValues, listLen);
+                }
+            }
+            break;
+#if GDAL_VERSION_MAJOR > 1
+        case OFTInteger64List:
+            {
+                int listLen = 0;
+                const GIntBig *listValues = ogrFeature->GetFieldAsInteger64List(fieldIdx, &listLen);
+                tuple.writeInt8Array(listValues, listLen);
+            }
+            break;
+#endif
+        case OFTRealList:
+            {
+                int listLen = 0;
+                const double *listValues = ogrFeature->GetFieldAsDoubleList(fieldIdx, &listLen);
+                tuple.writeFloat8Array(listValues, listLen);
+            }
+            break;
+        case OFTStringList:
+            {
+                char **listValues = ogrFeature->GetFieldAsStringList(fieldIdx);
+                // the element type stored in the array needs to match the
+                // element type of the column
+                Oid elementOid = (column.pgTypeOid == TypeOid::VARCHAR_ARRAY) ? TypeOid::VARCHAR : TypeOid::TEXT;
+                tuple.writeTextArray(elementOid, listValues, CSLCount(listValues));
+            }
+            break;
+        case OFTBinary:
+            {
+                int length = 0;
+                const GByte * value = ogrFeature->GetFieldAsBinary(fieldIdx, &length);
+                tuple.writeBytes(reinterpret_cast<const char *>(value), length);
+            }
+            break;
+        default:
+            throw WorkerError("Unsupported OGR field type for binary COPY: " + std::to_string(static_cast<int>(column.fieldType)));
+    }
+}
+
+
+void
+BinaryCopyEncoder::writeGeometry()
+{
+    if (wkbSize == 0) {
+        tuple.writeNull();
+        return;
+    }
+
+    // the geometry type of postgis accepts WKB in its binary representation
+    tuple.writeBytes(reinterpret_cast<const char *>(wkbBuffer.data()), wkbSize);
+}
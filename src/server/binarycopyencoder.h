@@ -0,0 +1,85 @@
+#ifndef __batyr_binarycopyencoder_h__
+#define __batyr_binarycopyencoder_h__
+
+#include <libpq-fe.h>
+
+#include <string>
+#include <vector>
+
+#include "server/db/binarycopy.h"
+#include "server/db/copystream.h"
+#include "server/columnplan.h"
+
+#include "ogrsf_frmts.h"
+
+
+namespace Batyr
+{
+
+    /**
+     * writes OGRFeatures in the binary COPY format.
+     *
+     * The values are converted directly to the binary representation
+     * of the type of the target column, so neither batyr nor the
+     * server need to format and parse text values.
+     */
+    class BinaryCopyEncoder
+    {
+        public:
+            typedef ColumnPlan::Column Column;
+
+            BinaryCopyEncoder(const ColumnPlan & _columnPlan);
+
+            /** disable copying */
+            BinaryCopyEncoder(const BinaryCopyEncoder &) = delete;
+            BinaryCopyEncoder& operator=(const BinaryCopyEncoder &) = delete;
+
+            /**
+             * check if values of the OGR field type can be written to
+             * a column using the postgresql type
+             */
+            static bool supports(OGRFieldType fieldType, Oid pgTypeOid);
+
+            /**
+             * check if the fid can be written to a column using
+             * the postgresql type
+             */
+            static bool supportsFid(Oid pgTypeOid);
+
+            /**
+             * check if all columns of the plan can be written
+             */
+            static bool supports(const ColumnPlan & columnPlan);
+
+            void writeHeader(Db::CopyStream & copyStream);
+            void writeFeature(OGRFeature * ogrFeature, Db::CopyStream & copyStream);
+            void writeTrailer(Db::CopyStream & copyStream);
+
+        private:
+            const ColumnPlan & columnPlan;
+            std::vector<Column> columns;
+
+            /** buffer for the current tuple. reused for all features */
+            Db::BinaryCopyBuffer tuple;
+
+            /** buffer for the WKB of the geometries. reused for all features */
+            std::vector<unsigned char> wkbBuffer;
+
+            /** size of the WKB of the current feature. 0 if it has no geometry */
+            size_t wkbSize;
+
+            /**
+             * text representation of the values of the current feature the
+             * digest is computed from. Only used when the plan has a digest
+             * column.
+             */
+            std::vector<QueryValue> digestValues;
+
+            void writeInteger(const Column & column, GIntBig value);
+            void writeField(OGRFeature * ogrFeature, const Column & column);
+            void writeGeometry();
+    };
+
+};
+
+#endif // __batyr_binarycopyencoder_h__
@@ -0,0 +1,134 @@
+#ifndef __batyr_boundedqueue_h_
+#define __batyr_boundedqueue_h_
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+
+namespace Batyr {
+
+    /**
+     * a queue with a max. number of items connecting the stages of
+     * a pipeline. Producers block while the queue is full, so a slow
+     * consumer slows down the producers instead of letting the queue
+     * grow.
+     */
+    template <typename T>
+        class BoundedQueue
+        {
+
+            private:
+                std::deque<T> queue_;
+                std::mutex mutex_;
+                std::condition_variable notEmpty_;
+                std::condition_variable notFull_;
+                size_t capacity_;
+                bool closed_;
+                bool aborted_;
+
+
+            public:
+
+                BoundedQueue(size_t capacity)
+                    :   capacity_(capacity > 0 ? capacity : 1),
+                        closed_(false),
+                        aborted_(false)
+                {}
+
+                /** disable copying */
+                BoundedQueue(const BoundedQueue &) = delete;
+
+                /** disable copying */
+                BoundedQueue& operator=(const BoundedQueue &) = delete;
+
+                /**
+                 * add an item to the end of the queue. Blocks while the
+                 * queue is full.
+                 *
+                 * returns false when the queue has been aborted. The item
+                 * is only moved when it was added.
+                 */
+                bool push(T && item)
+                {
+                    std::unique_lock<std::mutex> mlock(mutex_);
+                    while (!aborted_ && (queue_.size() >= capacity_)) {
+                        notFull_.wait(mlock);
+                    }
+                    if (aborted_) {
+                        return false;
+                    }
+                    queue_.push_back(std::move(item));
+                    mlock.unlock();
+                    notEmpty_.notify_one();
+                    return true;
+                }
+
+                /**
+                 * move the next item of the queue to the item parameter
+                 * and return true. Blocks while the queue is empty.
+                 *
+                 * returns false when the queue has been aborted or when
+                 * it has been closed and all items have been consumed.
+                 */
+                bool pop(T& item)
+                {
+                    std::unique_lock<std::mutex> mlock(mutex_);
+                    while (!aborted_ && !closed_ && queue_.empty()) {
+                        notEmpty_.wait(mlock);
+                    }
+                    if (aborted_ || queue_.empty()) {
+                        return false;
+                    }
+                    item = std::move(queue_.front());
+                    queue_.pop_front();
+                    mlock.unlock();
+                    notFull_.notify_one();
+                    return true;
+                }
+
+                /**
+                 * no more items will be added. Consumers still receive the
+                 * items already in the queue.
+                 */
+                void close()
+                {
+                    std::unique_lock<std::mutex> mlock(mutex_);
+                    closed_ = true;
+                    notEmpty_.notify_all();
+                }
+
+                /**
+                 * stop the queue and wake up all producers and consumers
+                 * waiting on it. The items remaining in the queue can still
+                 * be fetched using drain.
+                 */
+                void abort()
+                {
+                    std::unique_lock<std::mutex> mlock(mutex_);
+                    aborted_ = true;
+                    notEmpty_.notify_all();
+                    notFull_.notify_all();
+                }
+
+                /**
+                 * remove the next remaining item regardless of the state
+                 * of the queue. returns false when the queue is empty.
+                 */
+                bool drain(T& item)
+                {
+                    std::unique_lock<std::mutex> mlock(mutex_);
+                    if (queue_.empty()) {
+                        return false;
+                    }
+                    item = std::move(queue_.front());
+                    queue_.pop_front();
+                    return true;
+                }
+
+        };
+
+};
+
+#endif // __batyr_boundedqueue_h_
@@ -1,8 +1,10 @@
 #include "server/broker.h"
 #include "server/worker.h"
+#include "server/stagingtable.h"
 
 #include <thread>
 #include <functional>
+#include <set>
 #include <stdexcept>
 
 
@@ -12,8 +14,21 @@ using namespace Batyr;
 Broker::Broker(Configuration::Ptr _configuration)
     :   logger(Poco::Logger::get("Broker")),
         jobs(std::make_shared<JobStorage>( std::chrono::duration<int>( _configuration->getMaxAgeDoneJobs() ) )),
+        sourceFingerprints(std::make_shared<SourceFingerprintCache>()),
+        watermarks(std::make_shared<WatermarkCache>()),
+        dbPool(std::make_shared<Db::ConnectionPool>(_configuration)),
+        metadataCache(std::make_shared<Db::MetadataCache>(_configuration)),
         configuration(_configuration)
 {
+    if (configuration->useAsyncRemoveByAttributes()) {
+        if (Db::AsyncExecutor::isSupported()) {
+            asyncExecutor = std::make_shared<Db::AsyncExecutor>();
+        }
+        else {
+            poco_warning(logger, "batyr was build without support for asynchronous database transactions."
+                        " Ignoring async_remove_by_attributes");
+        }
+    }
 }
 
 
@@ -27,18 +42,59 @@ void
 Broker::addListener(std::shared_ptr<Batyr::BaseListener> listener_ptr)
 {
     listener_ptr->setJobs(jobs);
+    listener_ptr->setDbPool(dbPool);
+    listener_ptr->setMetadataCache(metadataCache);
+    listener_ptr->setAsyncExecutor(asyncExecutor);
     listeners.push_back(listener_ptr);
 }
 
 
+void
+Broker::removeOrphanedStagingTables()
+{
+    std::set<std::string> stagingSchemas;
+    for (const auto & layer : configuration->getOrderedLayers()) {
+        if (!layer->staging_schema.empty()) {
+            stagingSchemas.insert(layer->staging_schema);
+        }
+    }
+    if (stagingSchemas.empty()) {
+        return;
+    }
+
+    try {
+        auto db = dbPool->acquire();
+        SharedStagingTable::removeOrphans(**db, stagingSchemas);
+    }
+    catch (Db::DbError & e) {
+        poco_warning(logger, std::string("Could not remove orphaned staging tables: ") + e.what());
+    }
+}
+
+
 void
 Broker::run()
 {
+    // maintain the idle database connections
+    dbPoolThread = std::make_shared<std::thread>(
+            std::bind(&Db::ConnectionPool::run, dbPool)
+    );
+
+    // remove-by-attributes jobs do not need to block a worker
+    if (asyncExecutor) {
+        asyncExecutorThread = std::make_shared<std::thread>(
+                std::bind(&Db::AsyncExecutor::run, asyncExecutor)
+        );
+    }
+
+    // staging tables of pulls interrupted by a crash
+    removeOrphanedStagingTables();
+
     // start all workers
     size_t _numWorkers = configuration->getNumWorkerThreads();
     poco_information(logger, "Starting " + std::to_string(_numWorkers) + " workers");
     for(size_t nW = 0; nW < _numWorkers; nW++) {
-        auto worker = std::unique_ptr<Worker>(new Worker(configuration, jobs));
+        auto worker = std::unique_ptr<Worker>(new Worker(configuration, jobs, sourceFingerprints, watermarks, dbPool, metadataCache, asyncExecutor));
         auto workerThread = std::make_shared<std::thread>(
                 std::bind(&Worker::run, std::move(worker))
         );
@@ -92,4 +148,20 @@ Broker::stop()
         }
         workerThreads.clear();
     }
+
+    // let the transactions started by the workers finish
+    if (asyncExecutor) {
+        asyncExecutor->stop();
+    }
+    if (asyncExecutorThread) {
+        asyncExecutorThread->join();
+        asyncExecutorThread.reset();
+    }
+
+    // close the database connections once no worker uses them anymore
+    dbPool->stop();
+    if (dbPoolThread) {
+        dbPoolThread->join();
+        dbPoolThread.reset();
+    }
 }
@@ -10,6 +10,11 @@
 #include "server/worker.h"
 #include "server/jobstorage.h"
 #include "server/configuration.h"
+#include "server/sourcefingerprint.h"
+#include "server/watermarkcache.h"
+#include "server/db/connectionpool.h"
+#include "server/db/metadatacache.h"
+#include "server/db/asyncexecutor.h"
 
 namespace Batyr {
    
@@ -19,10 +24,23 @@ namespace Batyr {
             Poco::Logger & logger;
             std::vector< std::shared_ptr<Batyr::BaseListener> > listeners;
             std::shared_ptr<JobStorage> jobs;
+            SourceFingerprintCache::Ptr sourceFingerprints;
+            WatermarkCache::Ptr watermarks;
+            Db::ConnectionPool::Ptr dbPool;
+            std::shared_ptr< std::thread > dbPoolThread;
+            Db::MetadataCache::Ptr metadataCache;
+            Db::AsyncExecutor::Ptr asyncExecutor;
+            std::shared_ptr< std::thread > asyncExecutorThread;
             std::vector< std::shared_ptr< std::thread > > workerThreads;
             std::vector< std::shared_ptr< std::thread > > listenerThreads;
             Configuration::Ptr configuration;
 
+            /**
+             * drop the staging tables left behind in the staging schemas
+             * of the layers by a previous crash
+             */
+            void removeOrphanedStagingTables();
+
         public:
             Broker(Configuration::Ptr);
 
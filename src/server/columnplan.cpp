@@ -0,0 +1,454 @@
+#include <Poco/Logger.h>
+
+#include "common/valueformat.h"
+#include "server/columnplan.h"
+#include "server/db/binarycopy.h"
+#include "server/rowdigest.h"
+#include "server/worker.h"
+
+
+using namespace Batyr;
+
+
+/**
+ * clear the value and return its string to format the new value into.
+ * The storage of the string is reused, so no allocation is needed once
+ * it is large enough.
+ */
+static inline std::string &
+resetValue(QueryValue & value)
+{
+    value.setIsNull(false);
+    std::string & out = value.getMutable();
+    out.clear();
+    return out;
+}
+
+
+static void
+convertString(OGRFeature * ogrFeature, int fieldIdx, QueryValue & value)
+{
+    value.setIsNull(ogrFeature->IsFieldSet(fieldIdx) == 0);
+    if (!value.isNull()) {
+        value.getMutable().assign(ogrFeature->GetFieldAsString(fieldIdx));
+    }
+}
+
+
+static void
+convertInteger(OGRFeature * ogrFeature, int fieldIdx, QueryValue & value)
+{
+    value.setIsNull(ogrFeature->IsFieldSet(fieldIdx) == 0);
+    if (!value.isNull()) {
+        ValueFormat::appendInteger(resetValue(value), ogrFeature->GetFieldAsInteger(fieldIdx));
+    }
+}
+
+
+#if GDAL_VERSION_MAJOR > 1
+static void
+convertInteger64(OGRFeature * ogrFeature, int fieldIdx, QueryValue & value)
+{
+    value.setIsNull(ogrFeature->IsFieldSet(fieldIdx) == 0);
+    if (!value.isNull()) {
+        ValueFormat::appendInteger(resetValue(value), ogrFeature->GetFieldAsInteger64(fieldIdx));
+    }
+}
+#endif
+
+
+static void
+convertReal(OGRFeature * ogrFeature, int fieldIdx, QueryValue & value)
+{
+    value.setIsNull(ogrFeature->IsFieldSet(fieldIdx) == 0);
+    if (!value.isNull()) {
+        ValueFormat::appendDouble(resetValue(value), ogrFeature->GetFieldAsDouble(fieldIdx));
+    }
+}
+
+
+template <OGRFieldType fieldType>
+static void
+convertDateTime(OGRFeature * ogrFeature, int fieldIdx, QueryValue & value)
+{
+    int dtYear = 0;
+    int dtMonth = 0;
+    int dtDay = 0;
+    int dtHour = 0;
+    int dtMinute = 0;
+    int dtSecond = 0;
+    int dtTZFlag = 0;
+
+    if (ogrFeature->GetFieldAsDateTime(fieldIdx, &dtYear, &dtMonth, &dtDay,
+                &dtHour, &dtMinute, &dtSecond, &dtTZFlag)) {
+        std::string & out = resetValue(value);
+
+        if (fieldType == OFTDate) {
+            ValueFormat::appendDate(out, dtYear, dtMonth, dtDay);
+        }
+        else if (fieldType == OFTTime) {
+            ValueFormat::appendTime(out, dtHour, dtMinute, dtSecond);
+        }
+        else {
+            ValueFormat::appendTimestamp(out, dtYear, dtMonth, dtDay, dtHour, dtMinute, dtSecond);
+        }
+    }
+    else {
+        value.setIsNull(true);
+        if (ogrFeature->IsFieldSet(fieldIdx) == 1) {
+            poco_debug(Poco::Logger::get("ColumnPlan"), "field at index " + std::to_string(fieldIdx) + ""
+                               " null, but also set.");
+        }
+    }
+}
+
+
+static void
+convertIntegerList(OGRFeature * ogrFeature, int fieldIdx, QueryValue & value)
+{
+    int listLen = 0;
+    const int *listValues = ogrFeature->GetFieldAsIntegerList(fieldIdx, &listLen);
+    ValueFormat::appendIntegerArray(resetValue(value), listValues, listLen);
+}
+
+
+#if GDAL_VERSION_MAJOR > 1
+static void
+convertInteger64List(OGRFeature * ogrFeature, int fieldIdx, QueryValue & value)
+{
+    int listLen = 0;
+    const GIntBig *listValues = ogrFeature->GetFieldAsInteger64List(fieldIdx, &listLen);
+    ValueFormat::appendIntegerArray(resetValue(value), listValues, listLen);
+}
+#endif
+
+
+static void
+convertRealList(OGRFeature * ogrFeature, int fieldIdx, QueryValue & value)
+{
+    int listLen = 0;
+    const double *listValues = ogrFeature->GetFieldAsDoubleList(fieldIdx, &listLen);
+    ValueFormat::appendDoubleArray(resetValue(value), listValues, listLen);
+}
+
+
+static void
+convertStringList(OGRFeature * ogrFeature, int fieldIdx, QueryValue & value)
+{
+    char **listValues = ogrFeature->GetFieldAsStringList(fieldIdx);
+    ValueFormat::appendTextArray(resetValue(value), listValues, CSLCount(listValues));
+}
+
+
+static void
+convertBinary(OGRFeature * ogrFeature, int fieldIdx, QueryValue & value)
+{
+    static const char hexDigits[] = "0123456789abcdef";
+
+    value.setIsNull(ogrFeature->IsFieldSet(fieldIdx) == 0);
+    if (!value.isNull()) {
+        int length = 0;
+        const GByte * data = ogrFeature->GetFieldAsBinary(fieldIdx, &length);
+
+        // hex format of bytea
+        std::string & out = resetValue(value);
+        out.reserve(2 + length * 2);
+        out.append("\\x");
+        for (int i=0; i<length; i++) {
+            out.push_back(hexDigits[data[i] >> 4]);
+            out.push_back(hexDigits[data[i] & 0x0F]);
+        }
+    }
+}
+
+
+static void
+convertFid(OGRFeature * ogrFeature, int, QueryValue & value)
+{
+    // fid is always an integer
+    // http://www.gdal.org/classOGRFeature.html#a45da957be1eb8aa824e3ee9dbfb9604c
+    ValueFormat::appendInteger(resetValue(value), ogrFeature->GetFID());
+}
+
+
+static void
+convertUnsupported(OGRFeature * ogrFeature, int fieldIdx, QueryValue &)
+{
+    OGRFieldType fieldType = ogrFeature->GetFieldDefnRef(fieldIdx)->GetType();
+    throw WorkerError("Unsupported OGR field type to convert to string: " + std::to_string(static_cast<int>(fieldType)));
+}
+
+
+static void
+convertGeometry(OGRFeature *, int, QueryValue & value)
+{
+    // the geometry gets exported separately as WKB
+    value.setIsNull(true);
+}
+
+
+static void
+convertDigest(OGRFeature *, int, QueryValue & value)
+{
+    // the digest is set by computeDigest once all values are known
+    value.setIsNull(true);
+}
+
+
+ColumnPlan::ColumnPlan()
+    :   geometryIdx(-1),
+        digestIdx(-1)
+{
+}
+
+
+void
+ColumnPlan::addField(const Db::Field & tableField, int fieldIdx, OGRFieldType fieldType)
+{
+    Column column;
+    column.name = tableField.name;
+    column.source = SOURCE_FIELD;
+    column.fieldIdx = fieldIdx;
+    column.fieldType = fieldType;
+    column.pgTypeName = tableField.pgTypeName;
+    column.pgTypeOid = tableField.pgTypeOid;
+
+    // empty time types are generaly invalid and most certainly result from
+    // string fields returned as empty strings
+    column.emptyIsNull = (tableField.pgTypeName == "timestamp") ||
+                         (tableField.pgTypeName == "timestampz") ||
+                         (tableField.pgTypeName == "time") ||
+                         (tableField.pgTypeName == "date");
+    column.convert = selectConverter(fieldType);
+    columns.push_back(column);
+}
+
+
+void
+ColumnPlan::addFid(const Db::Field & tableField)
+{
+    Column column;
+    column.name = tableField.name;
+    column.source = SOURCE_FID;
+    column.fieldIdx = -1;
+#if GDAL_VERSION_MAJOR > 1
+    column.fieldType = OFTInteger64;
+#else
+    column.fieldType = OFTInteger;
+#endif
+    column.pgTypeName = tableField.pgTypeName;
+    column.pgTypeOid = tableField.pgTypeOid;
+    column.emptyIsNull = false;
+    column.convert = convertFid;
+    columns.push_back(column);
+}
+
+
+void
+ColumnPlan::addGeometry(const Db::Field & tableField)
+{
+    if (geometryIdx >= 0) {
+        throw WorkerError("Only one geometry column is supported");
+    }
+
+    Column column;
+    column.name = tableField.name;
+    column.source = SOURCE_GEOMETRY;
+    column.fieldIdx = -1;
+    column.fieldType = OFTBinary;
+    column.pgTypeName = tableField.pgTypeName;
+    column.pgTypeOid = tableField.pgTypeOid;
+    column.emptyIsNull = false;
+    column.convert = convertGeometry;
+
+    geometryIdx = static_cast<int>(columns.size());
+    columns.push_back(column);
+}
+
+
+void
+ColumnPlan::addDigest(const Db::Field & tableField)
+{
+    if (digestIdx >= 0) {
+        throw WorkerError("Only one digest column is supported");
+    }
+    if (tableField.pgTypeOid != Db::TypeOid::INT8) {
+        throw WorkerError("The digest column \"" + tableField.name + "\" needs to be of type bigint");
+    }
+
+    Column column;
+    column.name = tableField.name;
+    column.source = SOURCE_DIGEST;
+    column.fieldIdx = -1;
+#if GDAL_VERSION_MAJOR > 1
+    column.fieldType = OFTInteger64;
+#else
+    column.fieldType = OFTInteger;
+#endif
+    column.pgTypeName = tableField.pgTypeName;
+    column.pgTypeOid = tableField.pgTypeOid;
+    column.emptyIsNull = false;
+    column.convert = convertDigest;
+
+    digestIdx = static_cast<int>(columns.size());
+    columns.push_back(column);
+}
+
+
+int64_t
+ColumnPlan::getDigest(const std::vector<QueryValue> & values, const unsigned char * wkb, size_t wkbSize) const
+{
+    RowDigest digest;
+    for (size_t i=0; i<values.size(); i++) {
+        if (static_cast<int>(i) == digestIdx) {
+            continue;
+        }
+        if (static_cast<int>(i) == geometryIdx) {
+            digest.updateValue(wkb, wkbSize > 0 ? static_cast<int32_t>(wkbSize) : -1);
+        }
+        else {
+            digest.updateValue(values[i]);
+        }
+    }
+    return digest.get();
+}
+
+
+void
+ColumnPlan::computeDigest(std::vector<QueryValue> & values, const unsigned char * wkb, size_t wkbSize) const
+{
+    if (digestIdx < 0) {
+        return;
+    }
+    ValueFormat::appendInteger(resetValue(values[digestIdx]), getDigest(values, wkb, wkbSize));
+}
+
+
+void
+ColumnPlan::convertFeature(OGRFeature * ogrFeature, std::vector<QueryValue> & values) const
+{
+    values.resize(columns.size());
+
+    auto value = values.begin();
+    for (const auto & column : columns) {
+        column.convert(ogrFeature, column.fieldIdx, *value);
+
+        if (column.emptyIsNull && !value->isNull() && value->getRef().empty()) {
+            value->setIsNull(true);
+        }
+        ++value;
+    }
+}
+
+
+size_t
+ColumnPlan::exportGeometryToWkb(OGRFeature * ogrFeature, std::vector<unsigned char> & wkbBuffer)
+{
+    auto ogrGeometry = ogrFeature->GetGeometryRef();
+    if (ogrGeometry == nullptr) {
+        return 0;
+    }
+
+    int wkbSize = ogrGeometry->WkbSize();
+    if (wkbSize <= 0) {
+        return 0;
+    }
+    if (wkbBuffer.size() < static_cast<size_t>(wkbSize)) {
+        wkbBuffer.resize(wkbSize);
+    }
+    if (ogrGeometry->exportToWkb(wkbNDR, wkbBuffer.data()) != OGRERR_NONE) {
+        throw WorkerError("Could not export the geometry of the feature with fid " + std::to_string(ogrFeature->GetFID()));
+    }
+    return wkbSize;
+}
+
+
+ColumnPlan::ValueConverter
+ColumnPlan::selectConverter(OGRFieldType fieldType)
+{
+    switch (fieldType) {
+        case OFTString:
+            return convertString;
+        case OFTInteger:
+            return convertInteger;
+#if GDAL_VERSION_MAJOR > 1
+        case OFTInteger64:
+            return convertInteger64;
+#endif
+        case OFTReal:
+            return convertReal;
+        case OFTDate:
+            return convertDateTime<OFTDate>;
+        case OFTTime:
+            return convertDateTime<OFTTime>;
+        case OFTDateTime:
+            return convertDateTime<OFTDateTime>;
+        case OFTIntegerList:
+            return convertIntegerList;
+#if GDAL_VERSION_MAJOR > 1
+        case OFTInteger64List:
+            return convertInteger64List;
+#endif
+        case OFTRealList:
+            return convertRealList;
+        case OFTStringList:
+            return convertStringList;
+        case OFTBinary:
+            return convertBinary;
+        default:
+            // fields of other types are not supported. Fail when they are
+            // actually converted.
+            return convertUnsupported;
+    }
+}
+
+
+std::string
+ColumnPlan::getPostgresType(OGRFieldType fieldType)
+{
+    std::string pgFieldType;
+
+    switch (fieldType) {
+        case OFTString:
+            pgFieldType = "text";
+            break;
+        case OFTInteger:
+            pgFieldType = "integer";
+            break;
+        case OFTReal:
+            pgFieldType = "double precision";
+            break;
+        case OFTDate:
+            pgFieldType = "date";
+            break;
+        case OFTTime:
+            pgFieldType = "time";
+            break;
+        case OFTDateTime:
+            pgFieldType = "timestamp";
+            break;
+        case OFTIntegerList:
+            pgFieldType = "integer[]";
+            break;
+        case OFTRealList:
+            pgFieldType = "double precision[]";
+            break;
+        case OFTStringList:
+            pgFieldType = "text[]";
+            break;
+        case OFTBinary:
+            pgFieldType = "bytea";
+            break;
+#if GDAL_VERSION_MAJOR > 1
+        case OFTInteger64:
+            pgFieldType = "bigint";
+            break;
+        case OFTInteger64List:
+            pgFieldType = "bigint[]";
+            break;
+#endif
+        default:
+            throw WorkerError("No supported PostgreSQL type for OGR field type: " + std::to_string(static_cast<int>(fieldType)));
+    }
+    return pgFieldType;
+}
@@ -0,0 +1,149 @@
+#ifndef __batyr_columnplan_h__
+#define __batyr_columnplan_h__
+
+#include <libpq-fe.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "server/db/field.h"
+#include "server/db/queryvalue.h"
+
+#include "ogrsf_frmts.h"
+
+
+namespace Batyr
+{
+
+    /**
+     * describes how the values of the columns written to the staging
+     * table are read from an OGRFeature.
+     *
+     * The plan is resolved once per job, so the conversion of the
+     * features only needs to iterate over a flat list of columns
+     * with pre-selected converters instead of looking up the fields
+     * by name.
+     */
+    class ColumnPlan
+    {
+        public:
+            enum Source
+            {
+                SOURCE_FIELD,
+                SOURCE_FID,
+                SOURCE_GEOMETRY,
+
+                /** digest over the values of all other columns */
+                SOURCE_DIGEST
+            };
+
+            /**
+             * convert the field at the given index to a postgresql
+             * compatible string
+             */
+            typedef void (*ValueConverter)(OGRFeature * ogrFeature, int fieldIdx, QueryValue & value);
+
+            struct Column
+            {
+                std::string name;
+                Source source;
+
+                /** index and type of the OGR field. Only used for SOURCE_FIELD */
+                int fieldIdx;
+                OGRFieldType fieldType;
+
+                /** type of the target column */
+                std::string pgTypeName;
+                Oid pgTypeOid;
+
+                /**
+                 * empty strings are invalid for the type of the target column and
+                 * get converted to null.
+                 */
+                bool emptyIsNull;
+
+                ValueConverter convert;
+            };
+
+            ColumnPlan();
+
+            void addField(const Db::Field & tableField, int fieldIdx, OGRFieldType fieldType);
+            void addFid(const Db::Field & tableField);
+            void addGeometry(const Db::Field & tableField);
+            void addDigest(const Db::Field & tableField);
+
+            const std::vector<Column> & getColumns() const
+            {
+                return columns;
+            }
+
+            size_t size() const
+            {
+                return columns.size();
+            }
+
+            /**
+             * position of the geometry column. -1 if there is none
+             */
+            int getGeometryIdx() const
+            {
+                return geometryIdx;
+            }
+
+            /**
+             * position of the digest column. -1 if there is none
+             */
+            int getDigestIdx() const
+            {
+                return digestIdx;
+            }
+
+            /**
+             * convert a feature to a list of values in the order of the
+             * columns. The value of the geometry column is always null, the
+             * geometry needs to be exported separately.
+             */
+            void convertFeature(OGRFeature * ogrFeature, std::vector<QueryValue> & values) const;
+
+            /**
+             * the digest of the values of all columns except the digest
+             * column and the WKB of the geometry.
+             *
+             * The values are always the text representation created by
+             * convertFeature, so the digest of a feature is the same for
+             * all staging methods.
+             */
+            int64_t getDigest(const std::vector<QueryValue> & values, const unsigned char * wkb, size_t wkbSize) const;
+
+            /**
+             * set the value of the digest column to the digest of the values
+             * of all other columns and the WKB of the geometry.
+             */
+            void computeDigest(std::vector<QueryValue> & values, const unsigned char * wkb, size_t wkbSize) const;
+
+            /**
+             * export the geometry of the feature as WKB to the buffer. The
+             * buffer is only enlarged, so it can be reused for all features.
+             *
+             * returns the size of the WKB or 0 if the feature has no geometry
+             */
+            static size_t exportGeometryToWkb(OGRFeature * ogrFeature, std::vector<unsigned char> & wkbBuffer);
+
+            /**
+             * the postgresql type the converted values of an OGR field
+             * type are formatted as
+             */
+            static std::string getPostgresType(OGRFieldType fieldType);
+
+        private:
+            std::vector<Column> columns;
+            int geometryIdx;
+            int digestIdx;
+
+            static ValueConverter selectConverter(OGRFieldType fieldType);
+    };
+
+};
+
+#endif // __batyr_columnplan_h__
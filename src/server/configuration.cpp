@@ -1,6 +1,7 @@
 #include "server/configuration.h"
 #include "common/iniparser.h"
 #include "common/macros.h"
+#include "common/config.h"
 #include "common/stringutils.h"
 
 #include <iostream>
@@ -21,7 +22,16 @@ Layer::Layer()
         ignore_failures(false),
         enabled(true),
         bulk_mode(false),
-        bulk_delete_method(BULK_DELETE)
+        bulk_delete_method(BULK_DELETE),
+        staging_method(STAGING_INSERT),
+        copy_flush_threshold(1024 * 1024),
+        insert_batch_size(1),
+        convert_threads(0),
+        explain_sync(false),
+        explain_sync_analyze(false),
+        staging_index(true),
+        staging_analyze(true),
+        source_fingerprint(FINGERPRINT_NONE)
 {
 }
 
@@ -32,7 +42,15 @@ Configuration::Configuration(const std::string & configFile)
         max_age_done_jobs(600),  // default value
         loglevel(Poco::Message::PRIO_INFORMATION),  // default value
         logfile(""),
-        use_persistent_connections(true)
+        use_persistent_connections(true),
+        db_pool_max_connections(-1),
+        db_pool_min_idle(0),
+        db_pool_max_idle(-1),
+        db_pool_idle_timeout(-1),
+        db_pool_max_lifetime(0),
+        db_pool_wait_timeout(SERVER_DB_POOL_WAIT_TIMEOUT),
+        metadata_cache_ttl(SERVER_METADATA_CACHE_TTL),
+        async_remove_by_attributes(false)
 {
     parse(configFile);
 }
@@ -51,6 +69,17 @@ Configuration::getLayer(const std::string & _layer) const
 }
 
 
+unsigned int
+Configuration::getDbPoolIdleTimeout() const
+{
+    if (db_pool_idle_timeout >= 0) {
+        return db_pool_idle_timeout;
+    }
+    // without persistent connections unused connections do not stay open
+    return use_persistent_connections ? 0 : SERVER_DB_POOL_IDLE_TIMEOUT;
+}
+
+
 std::vector<Layer::Ptr>
 Configuration::getOrderedLayers() const
 {
@@ -137,6 +166,15 @@ Configuration::parse(const std::string & configFile)
             TARGET_VAR = _tmp_bool; \
         }
 
+#define GET_NON_NEGATIVE_INT_SETTING(TARGET_VAR, SETTING_NAME, STR_VALUE) { \
+            bool ok = false; \
+            int _tmp_int = valueToInt(STR_VALUE, ok); \
+            if (!ok || (_tmp_int < 0)) { \
+                throw ConfigurationError(SETTING_NAME + " must be a non-negative integer value."); \
+            } \
+            TARGET_VAR = _tmp_int; \
+        }
+
     try {
 
         Ini::Parser parser(ifs);
@@ -195,6 +233,30 @@ Configuration::parse(const std::string & configFile)
                     else if (valuePair.first == "use_persistent_connections") {
                         GET_BOOLEAN_SETTING(use_persistent_connections, valuePair.first, valuePair.second);
                     }
+                    else if (valuePair.first == "db_pool_max_connections") {
+                        GET_NON_NEGATIVE_INT_SETTING(db_pool_max_connections, valuePair.first, valuePair.second);
+                    }
+                    else if (valuePair.first == "db_pool_min_idle") {
+                        GET_NON_NEGATIVE_INT_SETTING(db_pool_min_idle, valuePair.first, valuePair.second);
+                    }
+                    else if (valuePair.first == "db_pool_max_idle") {
+                        GET_NON_NEGATIVE_INT_SETTING(db_pool_max_idle, valuePair.first, valuePair.second);
+                    }
+                    else if (valuePair.first == "db_pool_idle_timeout") {
+                        GET_NON_NEGATIVE_INT_SETTING(db_pool_idle_timeout, valuePair.first, valuePair.second);
+                    }
+                    else if (valuePair.first == "db_pool_max_lifetime") {
+                        GET_NON_NEGATIVE_INT_SETTING(db_pool_max_lifetime, valuePair.first, valuePair.second);
+                    }
+                    else if (valuePair.first == "db_pool_wait_timeout") {
+                        GET_NON_NEGATIVE_INT_SETTING(db_pool_wait_timeout, valuePair.first, valuePair.second);
+                    }
+                    else if (valuePair.first == "metadata_cache_ttl") {
+                        GET_NON_NEGATIVE_INT_SETTING(metadata_cache_ttl, valuePair.first, valuePair.second);
+                    }
+                    else if (valuePair.first == "async_remove_by_attributes") {
+                        GET_BOOLEAN_SETTING(async_remove_by_attributes, valuePair.first, valuePair.second);
+                    }
                     else {
                         throwUnknownSetting(sectionPair.first, valuePair.first);
                     }
@@ -219,6 +281,12 @@ Configuration::parse(const std::string & configFile)
                         else if (layerValuePair.first == "target_table_schema") {
                             layer->target_table_schema = layerValuePair.second;
                         }
+                        else if (layerValuePair.first == "incremental_column") {
+                            layer->incremental_column = layerValuePair.second;
+                        }
+                        else if (layerValuePair.first == "digest_column") {
+                            layer->digest_column = layerValuePair.second;
+                        }
                         else if (layerValuePair.first == "target_table_name") {
                             layer->target_table_name = layerValuePair.second;
                         }
@@ -243,6 +311,33 @@ Configuration::parse(const std::string & configFile)
                                 }
                             }
                         }
+                        else if (layerValuePair.first == "explain_sync") {
+                            GET_BOOLEAN_SETTING(layer->explain_sync, layerValuePair.first, layerValuePair.second);
+                        }
+                        else if (layerValuePair.first == "explain_sync_analyze") {
+                            GET_BOOLEAN_SETTING(layer->explain_sync_analyze, layerValuePair.first, layerValuePair.second);
+                        }
+                        else if (layerValuePair.first == "staging_index") {
+                            GET_BOOLEAN_SETTING(layer->staging_index, layerValuePair.first, layerValuePair.second);
+                        }
+                        else if (layerValuePair.first == "staging_analyze") {
+                            GET_BOOLEAN_SETTING(layer->staging_analyze, layerValuePair.first, layerValuePair.second);
+                        }
+                        else if (layerValuePair.first == "staging_schema") {
+                            layer->staging_schema = layerValuePair.second;
+                        }
+                        else if (layerValuePair.first == "work_mem") {
+                            layer->work_mem = layerValuePair.second;
+                        }
+                        else if (layerValuePair.first == "temp_buffers") {
+                            layer->temp_buffers = layerValuePair.second;
+                        }
+                        else if (layerValuePair.first == "temp_tablespaces") {
+                            layer->temp_tablespaces = layerValuePair.second;
+                        }
+                        else if (layerValuePair.first == "synchronous_commit") {
+                            layer->synchronous_commit = layerValuePair.second;
+                        }
                         else if (layerValuePair.first == "bulk_mode") {
                             GET_BOOLEAN_SETTING(layer->bulk_mode, layerValuePair.first, layerValuePair.second);
                         }
@@ -254,10 +349,79 @@ Configuration::parse(const std::string & configFile)
                             else if (bulkMethodStr == "truncate") {
                                 layer->bulk_delete_method = Batyr::BULK_TRUNCATE;
                             }
+                            else if (bulkMethodStr == "swap") {
+                                layer->bulk_delete_method = Batyr::BULK_SWAP;
+                            }
                             else {
                                 throw ConfigurationError("Unknown bulk delete method: \"" + layerValuePair.second + "\"");
                             }
                         }
+                        else if (layerValuePair.first == "source_fingerprint") {
+                            std::string fingerprintStr = StringUtils::tolower(StringUtils::trim(layerValuePair.second, trimChars));
+                            if (fingerprintStr == "none") {
+                                layer->source_fingerprint = Batyr::FINGERPRINT_NONE;
+                            }
+                            else if (fingerprintStr == "mtime") {
+                                layer->source_fingerprint = Batyr::FINGERPRINT_MTIME;
+                            }
+                            else if (fingerprintStr == "content") {
+                                layer->source_fingerprint = Batyr::FINGERPRINT_CONTENT;
+                            }
+                            else {
+                                throw ConfigurationError("Unknown source fingerprint method: \"" + layerValuePair.second + "\"");
+                            }
+                        }
+                        else if (layerValuePair.first == "staging_method") {
+                            std::string stagingMethodStr = StringUtils::tolower(StringUtils::trim(layerValuePair.second, trimChars));
+                            if (stagingMethodStr == "insert") {
+                                layer->staging_method = Batyr::STAGING_INSERT;
+                            }
+                            else if (stagingMethodStr == "copy") {
+                                layer->staging_method = Batyr::STAGING_COPY;
+                            }
+                            else {
+                                throw ConfigurationError("Unknown staging method: \"" + layerValuePair.second + "\"");
+                            }
+                        }
+                        else if (layerValuePair.first == "copy_flush_threshold") {
+                            bool ok = false;
+                            int _copy_flush_threshold = valueToInt(layerValuePair.second, ok);
+                            if (!ok) {
+                                throwInvalidValue(layerSectionPair.first,
+                                            layerValuePair.first,
+                                            layerValuePair.second);
+                            }
+                            if (_copy_flush_threshold < 1) {
+                                throw ConfigurationError("copy_flush_threshold must be a positive value.");
+                            }
+                            layer->copy_flush_threshold = _copy_flush_threshold;
+                        }
+                        else if (layerValuePair.first == "insert_batch_size") {
+                            bool ok = false;
+                            int _insert_batch_size = valueToInt(layerValuePair.second, ok);
+                            if (!ok) {
+                                throwInvalidValue(layerSectionPair.first,
+                                            layerValuePair.first,
+                                            layerValuePair.second);
+                            }
+                            if (_insert_batch_size < 1) {
+                                throw ConfigurationError("insert_batch_size must be a positive value.");
+                            }
+                            layer->insert_batch_size = _insert_batch_size;
+                        }
+                        else if (layerValuePair.first == "convert_threads") {
+                            bool ok = false;
+                            int _convert_threads = valueToInt(layerValuePair.second, ok);
+                            if (!ok) {
+                                throwInvalidValue(layerSectionPair.first,
+                                            layerValuePair.first,
+                                            layerValuePair.second);
+                            }
+                            if (_convert_threads < 0) {
+                                throw ConfigurationError("convert_threads must not be negative.");
+                            }
+                            layer->convert_threads = _convert_threads;
+                        }
                         else {
                             throwUnknownSetting(layerSectionPair.first, layerValuePair.first);
                         }
@@ -276,6 +440,12 @@ Configuration::parse(const std::string & configFile)
 
 #undef CHECK_LAYER_STR_SETTING
 
+                    if (layer->bulk_mode && !layer->incremental_column.empty()) {
+                        // bulk mode replaces all features of the target table
+                        throw ConfigurationError("Layer \"" + layer->name + "\" can not use \"incremental_column\""
+                                " together with \"bulk_mode\"");
+                    }
+
                     if (layer->enabled) {
                         layers[layer->name] = layer;
                     }
@@ -343,5 +513,6 @@ Configuration::parse(const std::string & configFile)
     }
 
 #undef GET_BOOLEAN_SETTING
+#undef GET_NON_NEGATIVE_INT_SETTING
 }
 
@@ -1,6 +1,7 @@
 #ifndef __batyr_configuration_h__
 #define __batyr_configuration_h__
 
+#include <algorithm>
 #include <string>
 #include <memory>
 #include <vector>
@@ -15,7 +16,29 @@ namespace Batyr
     enum BulkDeleteMethod
     {
         BULK_DELETE,
-        BULK_TRUNCATE
+        BULK_TRUNCATE,
+        BULK_SWAP
+    };
+
+    /**
+     * how to detect that the source of a layer did not change since
+     * the last successful pull
+     */
+    enum SourceFingerprintMethod
+    {
+        FINGERPRINT_NONE,
+        FINGERPRINT_MTIME,
+        FINGERPRINT_CONTENT
+    };
+
+    /**
+     * the way features are written to the temporary
+     * staging table
+     */
+    enum StagingMethod
+    {
+        STAGING_INSERT,
+        STAGING_COPY
     };
 
     struct Layer
@@ -27,12 +50,58 @@ namespace Batyr
         std::string target_table_name;
         std::string target_table_schema;
         std::string filter;
+
+        /** column of the target table storing a digest of the values of each row */
+        std::string digest_column;
         bool allow_feature_deletion;
         bool ignore_failures;
         std::vector<std::string> primary_key_columns;
         bool enabled;
         bool bulk_mode;
         BulkDeleteMethod bulk_delete_method;
+        StagingMethod staging_method;
+
+        /** size of the COPY buffer in bytes */
+        unsigned int copy_flush_threshold;
+
+        /** number of features per insert statement when staging using inserts */
+        unsigned int insert_batch_size;
+
+        /** number of threads converting the features. 0 converts them in the worker thread */
+        unsigned int convert_threads;
+
+        /** log the query plans of the statements synchronizing the target table */
+        bool explain_sync;
+
+        /** execute the explained statements to log the actual timings of their plans */
+        bool explain_sync_analyze;
+
+        /** index the primary key columns of the staging table after loading it */
+        bool staging_index;
+
+        /** collect statistics of the staging table after loading it */
+        bool staging_analyze;
+
+        /**
+         * schema to create the staging table in as an unlogged table. Empty
+         * uses a temporary table.
+         */
+        std::string staging_schema;
+
+        /**
+         * values of server settings applied to the transaction of a pull
+         * using "set local". Empty values keep the setting of the server.
+         */
+        std::string work_mem;
+        std::string temp_buffers;
+        std::string temp_tablespaces;
+        std::string synchronous_commit;
+
+        /** column used to only pull the features which changed since the last pull */
+        std::string incremental_column;
+
+        /** skip pulls when the fingerprint of the source did not change */
+        SourceFingerprintMethod source_fingerprint;
 
         typedef std::shared_ptr<Layer> Ptr;
 
@@ -101,6 +170,66 @@ namespace Batyr
                 return use_persistent_connections;
             }
 
+            /**
+             * maximum number of open database connections. Defaults to
+             * the number of workers.
+             */
+            unsigned int getDbPoolMaxConnections() const
+            {
+                return (db_pool_max_connections > 0) ? db_pool_max_connections : num_worker_threads;
+            }
+
+            /** number of idle connections kept open in advance */
+            unsigned int getDbPoolMinIdle() const
+            {
+                return std::min(static_cast<unsigned int>(db_pool_min_idle), getDbPoolMaxConnections());
+            }
+
+            /** idle connections beyond this number are closed immediately */
+            unsigned int getDbPoolMaxIdle() const
+            {
+                return (db_pool_max_idle >= 0) ? db_pool_max_idle : getDbPoolMaxConnections();
+            }
+
+            /**
+             * seconds after which unused connections are closed. 0 keeps
+             * them open - which is the default for persistent connections.
+             */
+            unsigned int getDbPoolIdleTimeout() const;
+
+            /** seconds after which connections get replaced. 0 disables this */
+            unsigned int getDbPoolMaxLifetime() const
+            {
+                return db_pool_max_lifetime;
+            }
+
+            /**
+             * seconds to wait for a connection when all connections are
+             * in use. 0 waits forever.
+             */
+            unsigned int getDbPoolWaitTimeout() const
+            {
+                return db_pool_wait_timeout;
+            }
+
+            /**
+             * seconds the catalog metadata of target tables is cached.
+             * 0 disables the cache.
+             */
+            unsigned int getMetadataCacheTtl() const
+            {
+                return metadata_cache_ttl;
+            }
+
+            /**
+             * execute the transactions of remove-by-attributes jobs without
+             * blocking a worker
+             */
+            bool useAsyncRemoveByAttributes() const
+            {
+                return async_remove_by_attributes;
+            }
+
             /**
              * get a vector with all layers ordered by their names
              */
@@ -126,6 +255,18 @@ namespace Batyr
             bool use_persistent_connections;
             std::string access_control_allow_origin;
 
+            /* settings of the database connection pool. Negative values use the defaults */
+            int db_pool_max_connections;
+            int db_pool_min_idle;
+            int db_pool_max_idle;
+            int db_pool_idle_timeout;
+            int db_pool_max_lifetime;
+            int db_pool_wait_timeout;
+
+            int metadata_cache_ttl;
+
+            bool async_remove_by_attributes;
+
 
             void parse(const std::string & configFile);
     };
@@ -0,0 +1,415 @@
+#include "server/db/asyncexecutor.h"
+#include "common/config.h"
+#include "common/macros.h"
+
+#include <cerrno>
+#include <cstring>
+
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+
+using namespace Batyr::Db;
+
+
+/** maximum number of events fetched by one call of epoll_wait */
+static const int maxEvents = 64;
+
+
+AsyncExecutor::AsyncExecutor()
+    :   logger(Poco::Logger::get("Db::AsyncExecutor")),
+        quit(false),
+        epollFd(-1),
+        wakeupFd(-1),
+        numInFlight(0),
+        numSubmitted(0),
+        numCompleted(0),
+        numFailed(0)
+{
+#ifdef HAVE_EPOLL
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0) {
+        throw DbError("Could not create the epoll instance: " + std::string(strerror(errno)));
+    }
+
+    wakeupFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (wakeupFd < 0) {
+        close(epollFd);
+        throw DbError("Could not create the eventfd: " + std::string(strerror(errno)));
+    }
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeupFd, &event) != 0) {
+        close(wakeupFd);
+        close(epollFd);
+        throw DbError("Could not watch the eventfd: " + std::string(strerror(errno)));
+    }
+#endif
+}
+
+
+AsyncExecutor::~AsyncExecutor()
+{
+#ifdef HAVE_EPOLL
+    if (wakeupFd >= 0) {
+        close(wakeupFd);
+    }
+    if (epollFd >= 0) {
+        close(epollFd);
+    }
+#endif
+}
+
+
+bool
+AsyncExecutor::isSupported()
+{
+#ifdef HAVE_EPOLL
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+void
+AsyncExecutor::wakeup()
+{
+#ifdef HAVE_EPOLL
+    uint64_t one = 1;
+    if (write(wakeupFd, &one, sizeof(one)) < 0 && (errno != EAGAIN)) {
+        poco_error(logger, "Could not wake up the executor: " + std::string(strerror(errno)));
+    }
+#endif
+}
+
+
+void
+AsyncExecutor::submit(PooledConnection::Ptr connection, std::vector<Statement> statements, Callback done)
+{
+    std::unique_ptr<Task> task(new Task());
+    task->connection = std::move(connection);
+    task->statements.push_back({"begin", {}});
+    for (auto & statement : statements) {
+        task->statements.push_back(std::move(statement));
+    }
+    task->statements.push_back({"commit", {}});
+    task->done = done;
+    task->current = 0;
+    task->rollingBack = false;
+    task->flushing = false;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!quit && isSupported()) {
+            numSubmitted++;
+            numInFlight++;
+            pending.push_back(std::move(task));
+        }
+    }
+
+    if (task) {
+        Result result;
+        result.error = std::make_shared<DbError>("The asynchronous executor has been shut down");
+        task->connection.reset();
+        done(result);
+        return;
+    }
+    wakeup();
+}
+
+
+bool
+AsyncExecutor::watch(Task & task, int op)
+{
+#ifdef HAVE_EPOLL
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    if (task.flushing) {
+        event.events |= EPOLLOUT;
+    }
+    event.data.ptr = &task;
+    return epoll_ctl(epollFd, op, PQsocket((*task.connection)->pgconn), &event) == 0;
+#else
+    UNUSED(task);
+    UNUSED(op);
+    return false;
+#endif
+}
+
+
+void
+AsyncExecutor::start(std::unique_ptr<Task> task)
+{
+    Task & t = *task;
+    tasks[&t] = std::move(task);
+
+    PGconn * pgconn = (*t.connection)->pgconn;
+    if ((pgconn == nullptr) || (PQsetnonblocking(pgconn, 1) != 0)) {
+        fail(t, "Could not switch the connection to the non-blocking mode");
+        return;
+    }
+#ifdef HAVE_EPOLL
+    if (!watch(t, EPOLL_CTL_ADD)) {
+        fail(t, "Could not watch the socket of the connection: " + std::string(strerror(errno)));
+        return;
+    }
+#endif
+    if (!send(t)) {
+        fail(t, "Sending the query failed: " + std::string(PQerrorMessage(pgconn)));
+    }
+}
+
+
+bool
+AsyncExecutor::send(Task & task)
+{
+    PGconn * pgconn = (*task.connection)->pgconn;
+
+    int sent;
+    if (task.rollingBack) {
+        sent = PQsendQuery(pgconn, "rollback");
+    }
+    else {
+        const auto & statement = task.statements[task.current];
+        PGParams params(statement.params);
+        sent = PQsendQueryParams(pgconn, statement.sql.c_str(), params.length(),
+                    NULL, params.values(), params.valueLenghts(), params.formats(), 0);
+    }
+    if (sent != 1) {
+        return false;
+    }
+
+    // the data has been copied to the output buffer of libpq
+    int flushed = PQflush(pgconn);
+    if (flushed < 0) {
+        return false;
+    }
+    bool flushing = (flushed == 1);
+    if (flushing != task.flushing) {
+        task.flushing = flushing;
+#ifdef HAVE_EPOLL
+        return watch(task, EPOLL_CTL_MOD);
+#endif
+    }
+    return true;
+}
+
+
+void
+AsyncExecutor::process(Task & task, uint32_t events)
+{
+    PGconn * pgconn = (*task.connection)->pgconn;
+
+#ifdef HAVE_EPOLL
+    if (task.flushing && (events & EPOLLOUT)) {
+        int flushed = PQflush(pgconn);
+        if (flushed < 0) {
+            fail(task, "Sending the query failed: " + std::string(PQerrorMessage(pgconn)));
+            return;
+        }
+        if (flushed == 0) {
+            task.flushing = false;
+            if (!watch(task, EPOLL_CTL_MOD)) {
+                fail(task, "Could not watch the socket of the connection: " + std::string(strerror(errno)));
+                return;
+            }
+        }
+    }
+    if (!(events & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
+        return;
+    }
+#else
+    UNUSED(events);
+#endif
+
+    if (PQconsumeInput(pgconn) != 1) {
+        fail(task, "Receiving the result failed: " + std::string(PQerrorMessage(pgconn)));
+        return;
+    }
+
+    while (!PQisBusy(pgconn)) {
+        PGresult * res = PQgetResult(pgconn);
+        if (res != nullptr) {
+            auto status = PQresultStatus(res);
+            if (status == PGRES_FATAL_ERROR) {
+                if (!task.result.error) {
+                    task.result.error = std::make_shared<DbError>(Transaction::errorFromResult(res));
+                }
+            }
+            else if (!task.rollingBack && (task.current > 0) && (task.current < task.statements.size() - 1)) {
+                task.result.numAffectedRows.push_back(std::atoi(PQcmdTuples(res)));
+            }
+            PQclear(res);
+            continue;
+        }
+
+        // all results of the statement have been received
+        if (task.rollingBack || (task.current == task.statements.size() - 1)) {
+            finish(task);
+            return;
+        }
+        if (task.result.error) {
+            task.rollingBack = true;
+        }
+        else {
+            task.current++;
+        }
+        if (!send(task)) {
+            fail(task, "Sending the query failed: " + std::string(PQerrorMessage(pgconn)));
+            return;
+        }
+    }
+}
+
+
+void
+AsyncExecutor::fail(Task & task, const std::string & message)
+{
+    poco_error(logger, message);
+    if (!task.result.error) {
+        task.result.error = std::make_shared<DbError>(message);
+    }
+
+    // the state of the connection is unknown, so it gets restored before
+    // being used again
+    (*task.connection)->close();
+    finish(task);
+}
+
+
+void
+AsyncExecutor::finish(Task & task)
+{
+    std::unique_ptr<Task> owned = std::move(tasks[&task]);
+    tasks.erase(&task);
+
+    PGconn * pgconn = (*owned->connection)->pgconn;
+    if (pgconn != nullptr) {
+#ifdef HAVE_EPOLL
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, PQsocket(pgconn), NULL);
+#endif
+        PQsetnonblocking(pgconn, 0);
+        if (PQtransactionStatus(pgconn) != PQTRANS_IDLE) {
+            // never hand out a connection with an open transaction
+            (*owned->connection)->close();
+        }
+        else {
+            (*owned->connection)->markUsed();
+        }
+    }
+    owned->connection.reset();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        numInFlight--;
+        if (owned->result.error) {
+            numFailed++;
+        }
+        else {
+            numCompleted++;
+        }
+    }
+
+    try {
+        owned->done(owned->result);
+    }
+    catch (std::exception & e) {
+        poco_error(logger, std::string("Callback of an asynchronous transaction failed: ") + e.what());
+    }
+}
+
+
+AsyncExecutor::Stats
+AsyncExecutor::getStats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    Stats stats;
+    stats.numInFlight = numInFlight;
+    stats.numSubmitted = numSubmitted;
+    stats.numCompleted = numCompleted;
+    stats.numFailed = numFailed;
+    return stats;
+}
+
+
+void
+AsyncExecutor::run()
+{
+#ifdef HAVE_EPOLL
+    struct epoll_event events[maxEvents];
+
+    while (true) {
+        std::deque<std::unique_ptr<Task>> submitted;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            submitted.swap(pending);
+            if (quit && submitted.empty() && tasks.empty()) {
+                break;
+            }
+        }
+        for (auto & task : submitted) {
+            start(std::move(task));
+        }
+        if (!submitted.empty()) {
+            // tasks may have failed right away
+            continue;
+        }
+
+        int numEvents = epoll_wait(epollFd, events, maxEvents, -1);
+        if (numEvents < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            poco_error(logger, "Waiting for the connections failed: " + std::string(strerror(errno)));
+            break;
+        }
+
+        for (int i=0; i<numEvents; i++) {
+            if (events[i].data.ptr == nullptr) {
+                uint64_t count;
+                while (read(wakeupFd, &count, sizeof(count)) > 0) {
+                }
+                continue;
+            }
+
+            // the task may have been finished while processing an earlier event
+            Task * task = static_cast<Task *>(events[i].data.ptr);
+            if (tasks.find(task) != tasks.end()) {
+                process(*task, events[i].events);
+            }
+        }
+    }
+
+    // only left on errors of epoll while transactions are still in progress
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+        for (auto & task : pending) {
+            Task * t = task.get();
+            tasks[t] = std::move(task);
+        }
+        pending.clear();
+    }
+    while (!tasks.empty()) {
+        fail(*(tasks.begin()->first), "The asynchronous executor has been stopped");
+    }
+#endif
+}
+
+
+void
+AsyncExecutor::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    wakeup();
+}
@@ -0,0 +1,178 @@
+#ifndef __batyr_db_asyncexecutor_h__
+#define __batyr_db_asyncexecutor_h__
+
+#include <Poco/Logger.h>
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "server/db/connection.h"
+#include "server/db/connectionpool.h"
+#include "server/db/queryvalue.h"
+
+
+namespace Batyr
+{
+namespace Db
+{
+
+    /**
+     * executes short transactions on borrowed connections without blocking
+     * a thread per connection.
+     *
+     * The statements are sent using the asynchronous functions of libpq and
+     * the sockets of all connections are watched by a single thread using
+     * epoll, so the thread submitting a transaction can go on with other
+     * work while the server executes it. Each transaction runs on the
+     * connection it was submitted with. The connection is returned to the
+     * pool once the transaction has ended.
+     *
+     * Requires epoll, see isSupported.
+     */
+    class AsyncExecutor
+    {
+        public:
+            struct Statement
+            {
+                std::string sql;
+                std::vector<QueryValue> params;
+            };
+
+            struct Result
+            {
+                /** set when the transaction failed and has been rolled back */
+                std::shared_ptr<DbError> error;
+
+                /** the number of rows affected by each of the statements */
+                std::vector<int> numAffectedRows;
+            };
+
+            /**
+             * called by the thread running the executor when the transaction
+             * has ended. Must not block.
+             */
+            typedef std::function<void(const Result &)> Callback;
+
+            struct Stats
+            {
+                size_t numInFlight;
+                uint64_t numSubmitted;
+                uint64_t numCompleted;
+                uint64_t numFailed;
+            };
+
+        private:
+            struct Task
+            {
+                PooledConnection::Ptr connection;
+
+                /** the submitted statements enclosed in begin and commit */
+                std::vector<Statement> statements;
+                Callback done;
+                Result result;
+
+                /** index of the statement currently executed */
+                size_t current;
+
+                /** a statement failed and the rollback has been sent */
+                bool rollingBack;
+
+                /** libpq could not yet send all data to the server */
+                bool flushing;
+            };
+
+            Poco::Logger & logger;
+
+            std::mutex mutex;
+            bool quit;
+
+            /** submitted tasks not yet picked up by run */
+            std::deque<std::unique_ptr<Task>> pending;
+
+            /** only accessed by the thread executing run */
+            std::unordered_map<Task *, std::unique_ptr<Task>> tasks;
+
+            int epollFd;
+
+            /** wakes up run when tasks have been submitted or stop has been called */
+            int wakeupFd;
+
+            size_t numInFlight;
+            uint64_t numSubmitted;
+            uint64_t numCompleted;
+            uint64_t numFailed;
+
+            void wakeup();
+
+            /**
+             * register the connection of the task and send its first
+             * statement
+             */
+            void start(std::unique_ptr<Task> task);
+
+            /**
+             * send the current statement - or the rollback after an error.
+             * Returns false when the connection failed.
+             */
+            bool send(Task & task);
+
+            /** update the events of the socket epoll waits for */
+            bool watch(Task & task, int op);
+
+            /** process the results which arrived for the task */
+            void process(Task & task, uint32_t events);
+
+            /** the connection of the task failed */
+            void fail(Task & task, const std::string & message);
+
+            /** unregister the task, return its connection and call its callback */
+            void finish(Task & task);
+
+        public:
+            AsyncExecutor();
+            ~AsyncExecutor();
+
+            /** disable copying */
+            AsyncExecutor(const AsyncExecutor &) = delete;
+            AsyncExecutor& operator=(const AsyncExecutor &) = delete;
+
+            /**
+             * check if the executor is supported. This requires batyr
+             * to be build on a system providing epoll.
+             */
+            static bool isSupported();
+
+            /**
+             * execute the statements in a transaction on the connection.
+             * Returns immediately - done gets called once the transaction
+             * has ended. After stop has been called the transaction fails
+             * without being executed.
+             */
+            void submit(PooledConnection::Ptr connection, std::vector<Statement> statements, Callback done);
+
+            Stats getStats();
+
+            /**
+             * execute the submitted transactions until stop gets called
+             * and all of them have ended. To be run in a thread of its own.
+             */
+            void run();
+
+            /**
+             * let run return once the transactions in progress have ended
+             */
+            void stop();
+
+            typedef std::shared_ptr<AsyncExecutor> Ptr;
+    };
+
+};
+};
+
+#endif // __batyr_db_asyncexecutor_h__
@@ -0,0 +1,220 @@
+#include "server/db/binarycopy.h"
+
+
+using namespace Batyr::Db;
+
+
+/**
+ * number of days since 2000-01-01 of the given date in the
+ * proleptic gregorian calendar
+ *
+ * see http://howardhinnant.github.io/date_algorithms.html#days_from_civil
+ */
+static int32_t
+daysSincePgEpoch(int year, int month, int day)
+{
+    year -= month <= 2;
+    const int era = (year >= 0 ? year : year - 399) / 400;
+    const int yoe = year - era * 400;
+    const int doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    const int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+    // 10957 days lie between 1970-01-01 and 2000-01-01
+    return era * 146097 + doe - 719468 - 10957;
+}
+
+
+void
+BinaryCopyBuffer::appendInt16(int16_t v)
+{
+    uint16_t u = static_cast<uint16_t>(v);
+    buffer.push_back(static_cast<char>(u >> 8));
+    buffer.push_back(static_cast<char>(u));
+}
+
+
+void
+BinaryCopyBuffer::appendInt32(int32_t v)
+{
+    uint32_t u = static_cast<uint32_t>(v);
+    char bytes[4] = {
+        static_cast<char>(u >> 24),
+        static_cast<char>(u >> 16),
+        static_cast<char>(u >> 8),
+        static_cast<char>(u)
+    };
+    buffer.append(bytes, sizeof(bytes));
+}
+
+
+void
+BinaryCopyBuffer::appendInt64(int64_t v)
+{
+    uint64_t u = static_cast<uint64_t>(v);
+    appendInt32(static_cast<int32_t>(u >> 32));
+    appendInt32(static_cast<int32_t>(u));
+}
+
+
+void
+BinaryCopyBuffer::appendArrayHeader(Oid elementOid, int numValues)
+{
+    // number of dimensions. empty arrays have none
+    appendInt32(numValues > 0 ? 1 : 0);
+    // flags: the array contains no nulls
+    appendInt32(0);
+    appendInt32(static_cast<int32_t>(elementOid));
+    if (numValues > 0) {
+        appendInt32(numValues);
+        // lower bound
+        appendInt32(1);
+    }
+}
+
+
+void
+BinaryCopyBuffer::writeHeader()
+{
+    static const char signature[] = "PGCOPY\n\377\r\n";
+
+    // the signature includes the terminating \0
+    buffer.append(signature, sizeof(signature));
+    // flags
+    appendInt32(0);
+    // length of the header extension
+    appendInt32(0);
+}
+
+
+void
+BinaryCopyBuffer::writeTrailer()
+{
+    appendInt16(-1);
+}
+
+
+void
+BinaryCopyBuffer::beginTuple(int16_t numFields)
+{
+    appendInt16(numFields);
+}
+
+
+void
+BinaryCopyBuffer::writeNull()
+{
+    appendInt32(-1);
+}
+
+
+void
+BinaryCopyBuffer::writeBool(bool v)
+{
+    appendInt32(1);
+    buffer.push_back(v ? 1 : 0);
+}
+
+
+void
+BinaryCopyBuffer::writeInt2(int16_t v)
+{
+    appendInt32(2);
+    appendInt16(v);
+}
+
+
+void
+BinaryCopyBuffer::writeInt4(int32_t v)
+{
+    appendInt32(4);
+    appendInt32(v);
+}
+
+
+void
+BinaryCopyBuffer::writeInt8(int64_t v)
+{
+    appendInt32(8);
+    appendInt64(v);
+}
+
+
+void
+BinaryCopyBuffer::writeFloat4(float v)
+{
+    int32_t i;
+    std::memcpy(&i, &v, sizeof(i));
+    writeInt4(i);
+}
+
+
+void
+BinaryCopyBuffer::writeFloat8(double v)
+{
+    int64_t i;
+    std::memcpy(&i, &v, sizeof(i));
+    writeInt8(i);
+}
+
+
+void
+BinaryCopyBuffer::writeBytes(const char * data, size_t length)
+{
+    appendInt32(static_cast<int32_t>(length));
+    buffer.append(data, length);
+}
+
+
+void
+BinaryCopyBuffer::writeDate(int year, int month, int day)
+{
+    writeInt4(daysSincePgEpoch(year, month, day));
+}
+
+
+void
+BinaryCopyBuffer::writeTime(int hour, int minute, int second)
+{
+    // microseconds since midnight
+    writeInt8((static_cast<int64_t>(hour) * 3600 + minute * 60 + second) * 1000000);
+}
+
+
+void
+BinaryCopyBuffer::writeTimestamp(int year, int month, int day, int hour, int minute, int second)
+{
+    // microseconds since 2000-01-01 00:00:00
+    int64_t seconds = static_cast<int64_t>(daysSincePgEpoch(year, month, day)) * 86400
+                + hour * 3600 + minute * 60 + second;
+    writeInt8(seconds * 1000000);
+}
+
+
+void
+BinaryCopyBuffer::writeFloat8Array(const double * values, int numValues)
+{
+    appendInt32(12 + (numValues > 0 ? 8 : 0) + numValues * 12);
+    appendArrayHeader(TypeOid::FLOAT8, numValues);
+    for (int i=0; i<numValues; i++) {
+        int64_t v;
+        std::memcpy(&v, &values[i], sizeof(v));
+        appendInt32(8);
+        appendInt64(v);
+    }
+}
+
+
+void
+BinaryCopyBuffer::writeTextArray(Oid elementOid, const char * const * values, int numValues)
+{
+    size_t totalLength = 12 + (numValues > 0 ? 8 : 0);
+    for (int i=0; i<numValues; i++) {
+        totalLength += 4 + std::strlen(values[i]);
+    }
+
+    appendInt32(static_cast<int32_t>(totalLength));
+    appendArrayHeader(elementOid, numValues);
+    for (int i=0; i<numValues; i++) {
+        writeBytes(values[i], std::strlen(values[i]));
+    }
+}
@@ -0,0 +1,144 @@
+#ifndef __batyr_db_binarycopy_h__
+#define __batyr_db_binarycopy_h__
+
+#include <libpq-fe.h>
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+
+namespace Batyr
+{
+namespace Db
+{
+
+    /**
+     * oids of the builtin postgresql types which are supported
+     * by the BinaryCopyBuffer
+     *
+     * see src/include/catalog/pg_type.h of the postgresql sources
+     */
+    namespace TypeOid
+    {
+        const Oid BOOL = 16;
+        const Oid BYTEA = 17;
+        const Oid INT8 = 20;
+        const Oid INT2 = 21;
+        const Oid INT4 = 23;
+        const Oid TEXT = 25;
+        const Oid FLOAT4 = 700;
+        const Oid FLOAT8 = 701;
+        const Oid INT4_ARRAY = 1007;
+        const Oid TEXT_ARRAY = 1009;
+        const Oid VARCHAR_ARRAY = 1015;
+        const Oid INT8_ARRAY = 1016;
+        const Oid FLOAT8_ARRAY = 1022;
+        const Oid BPCHAR = 1042;
+        const Oid VARCHAR = 1043;
+        const Oid DATE = 1082;
+        const Oid TIME = 1083;
+        const Oid TIMESTAMP = 1114;
+    };
+
+
+    /**
+     * builds data in the binary format of "COPY ... FROM STDIN WITH BINARY"
+     *
+     * All numbers are written in network byte order. Dates and timestamps
+     * use the integer representation relative to 2000-01-01 which is the
+     * default since postgresql 8.4.
+     *
+     * see http://www.postgresql.org/docs/current/static/sql-copy.html
+     */
+    class BinaryCopyBuffer
+    {
+        private:
+            std::string buffer;
+
+            void appendInt16(int16_t v);
+            void appendInt32(int32_t v);
+            void appendInt64(int64_t v);
+
+            /** write the fixed-width elements of an one-dimensional array */
+            template <typename T>
+            void writeArray(Oid elementOid, int32_t elementSize, const T * values, int numValues)
+            {
+                appendInt32(12 + (numValues > 0 ? 8 : 0) + numValues * (4 + elementSize));
+                appendArrayHeader(elementOid, numValues);
+                for (int i=0; i<numValues; i++) {
+                    appendInt32(elementSize);
+                    if (elementSize == 8) {
+                        appendInt64(static_cast<int64_t>(values[i]));
+                    }
+                    else {
+                        appendInt32(static_cast<int32_t>(values[i]));
+                    }
+                }
+            }
+
+            void appendArrayHeader(Oid elementOid, int numValues);
+
+        public:
+            /** the signature and header which has to start the data */
+            void writeHeader();
+
+            /** the trailer which has to end the data */
+            void writeTrailer();
+
+            void beginTuple(int16_t numFields);
+
+            void writeNull();
+            void writeBool(bool v);
+            void writeInt2(int16_t v);
+            void writeInt4(int32_t v);
+            void writeInt8(int64_t v);
+            void writeFloat4(float v);
+            void writeFloat8(double v);
+
+            /**
+             * write the value as it is. Used for text, bytea and other types
+             * which receive their raw data - like the postgis geometry type
+             * which accepts WKB.
+             */
+            void writeBytes(const char * data, size_t length);
+
+            void writeDate(int year, int month, int day);
+            void writeTime(int hour, int minute, int second);
+            void writeTimestamp(int year, int month, int day, int hour, int minute, int second);
+
+            void writeInt4Array(const int * values, int numValues)
+            {
+                writeArray(TypeOid::INT4, 4, values, numValues);
+            }
+
+            template <typename T>
+            void writeInt8Array(const T * values, int numValues)
+            {
+                writeArray(TypeOid::INT8, 8, values, numValues);
+            }
+
+            void writeFloat8Array(const double * values, int numValues);
+
+            void writeTextArray(Oid elementOid, const char * const * values, int numValues);
+
+            const char * data() const
+            {
+                return buffer.data();
+            }
+
+            size_t size() const
+            {
+                return buffer.size();
+            }
+
+            void clear()
+            {
+                buffer.clear();
+            }
+    };
+
+};
+};
+
+#endif // __batyr_db_binarycopy_h__
@@ -1,4 +1,5 @@
 #include <cstring>
+#include <poll.h>
 
 #include "server/db/connection.h"
 #include "server/db/transaction.h"
@@ -26,7 +27,8 @@ Connection::Connection(Batyr::Configuration::Ptr _configuration)
     :   logger(Poco::Logger::get("Db::Connection")),
         configuration(_configuration),
         pgconn(0),
-        connection_ok(true)
+        connection_ok(true),
+        lastHealthCheck(HEALTH_CHECK_SKIPPED)
 {
     poco_debug(logger, "Setting up connection object");
 
@@ -58,15 +60,8 @@ Connection::reconnect(bool restore)
 {
     if (pgconn != nullptr) {
 
-        // just send a single sql command to ger useful info if
-        // the connection is alive
-        auto res = PQexec(pgconn, "select 1");
-        if (res != nullptr) {
-            PQclear(res);
-        }
-
         // check if the connection is fine
-        if (PQstatus(pgconn) != CONNECTION_OK) {
+        if (!checkHealth()) {
             if (restore) {
 
                 // only log this message once per dead connection
@@ -84,6 +79,7 @@ Connection::reconnect(bool restore)
                     connection_ok = true;
                     poco_error(logger, "Successfully reconnected to database");
                     setApplicationName();
+                    markUsed();
                 }
             }
             else {
@@ -108,6 +104,7 @@ Connection::reconnect(bool restore)
             connection_ok = true;
             poco_debug(logger, "Successfully connected to the database");
             setApplicationName();
+            markUsed();
 
             PQsetNoticeProcessor(pgconn, noticeProcessor, &logger);
         }
@@ -121,6 +118,60 @@ Connection::reconnect(bool restore)
 }
 
 
+bool
+Connection::checkHealth()
+{
+    if ((pgconn == nullptr) || (PQstatus(pgconn) != CONNECTION_OK)) {
+        lastHealthCheck = HEALTH_CHECK_FAILED;
+        return false;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastUsed < std::chrono::milliseconds(SERVER_DB_HEALTH_CHECK_INTERVAL)) {
+        lastHealthCheck = HEALTH_CHECK_SKIPPED;
+        return true;
+    }
+
+    // check for data without waiting
+    struct pollfd pfd;
+    pfd.fd = PQsocket(pgconn);
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    int numReady = poll(&pfd, 1, 0);
+    if (numReady == 0) {
+        lastHealthCheck = HEALTH_CHECK_SOCKET;
+        return true;
+    }
+
+    // reading the data detects a connection closed by the server
+    if ((numReady < 0) || (PQconsumeInput(pgconn) == 0) || (PQstatus(pgconn) != CONNECTION_OK)) {
+        lastHealthCheck = HEALTH_CHECK_FAILED;
+        return false;
+    }
+
+    // the data did not close the connection - possibly a notice. Only a
+    // query tells if the connection is still usable
+    lastHealthCheck = HEALTH_CHECK_QUERY;
+    auto res = PQexec(pgconn, "select 1");
+    if (res != nullptr) {
+        PQclear(res);
+    }
+    if (PQstatus(pgconn) != CONNECTION_OK) {
+        lastHealthCheck = HEALTH_CHECK_FAILED;
+        return false;
+    }
+    markUsed();
+    return true;
+}
+
+
+void
+Connection::markUsed()
+{
+    lastUsed = std::chrono::steady_clock::now();
+}
+
+
 std::unique_ptr<Transaction>
 Connection::getTransaction()
 {
@@ -143,6 +194,21 @@ Connection::getVersion()
 }
 
 
+std::string
+Connection::getTarget()
+{
+    if (pgconn == nullptr) {
+        throw DbError("not connected to a database");
+    }
+
+    // libpq returns NULL for unset values in some versions
+    auto str = [](const char * value) {
+        return std::string(value != nullptr ? value : "");
+    };
+    return str(PQhost(pgconn)) + ":" + str(PQport(pgconn)) + "/" + str(PQdb(pgconn));
+}
+
+
 void
 Connection::setApplicationName()
 {
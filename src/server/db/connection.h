@@ -5,6 +5,7 @@
 
 #include <libpq-fe.h>
 
+#include <chrono>
 #include <string>
 #include <memory>
 #include <stdexcept>
@@ -48,6 +49,16 @@ namespace Db
                 return !sqlstate.empty() && (sqlstate.compare(0, 2, "22") == 0);
             }
 
+            /**
+             * is sqlstate one of the errors caused by statements relying on
+             * a structure of a table which has been changed by DDL:
+             * undefined_table, undefined_column or datatype_mismatch
+             */
+            bool isSchemaChange() const
+            {
+                return (sqlstate == "42P01") || (sqlstate == "42703") || (sqlstate == "42804");
+            }
+
             bool hasContext() const
             {
                 return !context.empty();
@@ -65,6 +76,25 @@ namespace Db
     };
 
 
+    /**
+     * how the health of a connection has been checked
+     */
+    enum HealthCheck
+    {
+        /** the connection has been used recently, so it was not checked */
+        HEALTH_CHECK_SKIPPED,
+
+        /** the socket of the connection has been checked for pending data */
+        HEALTH_CHECK_SOCKET,
+
+        /** the server sent data to the idle connection, so a query was sent */
+        HEALTH_CHECK_QUERY,
+
+        /** the connection is broken */
+        HEALTH_CHECK_FAILED
+    };
+
+
     class Connection {
 
         private:
@@ -81,6 +111,17 @@ namespace Db
              */
             bool connection_ok;
 
+            /**
+             * the last time a transaction on the connection completed
+             * successfully
+             */
+            std::chrono::steady_clock::time_point lastUsed;
+
+            HealthCheck lastHealthCheck;
+
+            /** called by Transaction */
+            void markUsed();
+
             /**
              * set the name of the application in postgresql to
              * show in pg_stat_activity
@@ -96,12 +137,28 @@ namespace Db
             typedef std::shared_ptr<Connection> Ptr;
 
             friend class Transaction;
+            friend class AsyncExecutor;
 
             /**
              * setup or check and attempt to restore the database connection
              */
             bool reconnect(bool restore);
 
+            /**
+             * check if the connection is still usable without restoring it.
+             *
+             * Connections which have been used recently are assumed to be fine.
+             * Otherwise the socket is checked for data sent by the server - which
+             * does not send anything to idle connections except when terminating
+             * them. Only when there is such data a query is sent to the server.
+             */
+            bool checkHealth();
+
+            HealthCheck getLastHealthCheck() const
+            {
+                return lastHealthCheck;
+            }
+
             /**
              * close the current connection
              */
@@ -112,6 +169,12 @@ namespace Db
              * according to the syntax of PQserverVersion
              */
             int getVersion();
+
+            /**
+             * host, port and database the connection is connected to
+             * in the form "host:port/database"
+             */
+            std::string getTarget();
     };
 
 
@@ -0,0 +1,374 @@
+#include "server/db/connectionpool.h"
+#include "common/config.h"
+
+#include <algorithm>
+#include <vector>
+
+
+using namespace Batyr::Db;
+
+
+PooledConnection::PooledConnection(std::shared_ptr<ConnectionPool> _pool, std::unique_ptr<Connection> _connection,
+            std::chrono::steady_clock::time_point _created)
+    :   pool(_pool),
+        connection(std::move(_connection)),
+        created(_created)
+{
+}
+
+
+PooledConnection::~PooledConnection()
+{
+    pool->release(std::move(connection), created);
+}
+
+
+ConnectionPool::ConnectionPool(Configuration::Ptr _configuration)
+    :   logger(Poco::Logger::get("Db::ConnectionPool")),
+        configuration(_configuration),
+        quit(false),
+        numBorrowed(0),
+        numWaiting(0),
+        numOpened(0),
+        numClosed(0),
+        numWaitTimeouts(0),
+        numHealthChecksSkipped(0),
+        numHealthChecksSocket(0),
+        numHealthChecksQuery(0),
+        numConnectAttempts(0),
+        numConnectFailures(0),
+        numConsecutiveConnectFailures(0),
+        backoff(0)
+{
+}
+
+
+ConnectionPool::~ConnectionPool()
+{
+    stop();
+}
+
+
+bool
+ConnectionPool::isExpired(std::chrono::steady_clock::time_point created,
+            std::chrono::steady_clock::time_point now) const
+{
+    auto maxLifetime = configuration->getDbPoolMaxLifetime();
+    return (maxLifetime > 0) && (now - created >= std::chrono::seconds(maxLifetime));
+}
+
+
+void
+ConnectionPool::countHealthCheck(HealthCheck healthCheck)
+{
+    switch (healthCheck) {
+        case HEALTH_CHECK_SKIPPED:
+            numHealthChecksSkipped++;
+            break;
+        case HEALTH_CHECK_SOCKET:
+            numHealthChecksSocket++;
+            break;
+        case HEALTH_CHECK_QUERY:
+            numHealthChecksQuery++;
+            break;
+        case HEALTH_CHECK_FAILED:
+            break;
+    }
+}
+
+
+void
+ConnectionPool::checkBackoff(std::chrono::steady_clock::time_point now)
+{
+    if ((numConsecutiveConnectFailures > 0) && (now < nextConnectAttempt)) {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(nextConnectAttempt - now);
+        throw DbError("Unable to connect to the database. Next attempt in "
+                    + std::to_string(remaining.count()) + "ms");
+    }
+}
+
+
+void
+ConnectionPool::recordConnectAttempt(bool success, std::chrono::steady_clock::time_point now)
+{
+    numConnectAttempts++;
+    if (success) {
+        if (numConsecutiveConnectFailures > 0) {
+            poco_information(logger, "Connected to the database after "
+                        + std::to_string(numConsecutiveConnectFailures) + " failed attempts");
+        }
+        numConsecutiveConnectFailures = 0;
+        backoff = std::chrono::milliseconds(0);
+        return;
+    }
+
+    numConnectFailures++;
+    numConsecutiveConnectFailures++;
+    if (backoff.count() == 0) {
+        backoff = std::chrono::milliseconds(SERVER_DB_RECONNECT_WAIT);
+    }
+    else {
+        backoff = std::min(backoff * 2, std::chrono::milliseconds(SERVER_DB_RECONNECT_MAX_WAIT));
+    }
+    nextConnectAttempt = now + backoff;
+}
+
+
+PooledConnection::Ptr
+ConnectionPool::acquire()
+{
+    auto waitTimeout = configuration->getDbPoolWaitTimeout();
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(waitTimeout);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        if (quit) {
+            throw DbError("The database connection pool has been shut down");
+        }
+
+        // reuse the most recently returned connection
+        while (!idle.empty()) {
+            IdleConnection idleConnection = std::move(idle.back());
+            idle.pop_back();
+
+            if (isExpired(idleConnection.created, std::chrono::steady_clock::now())) {
+                numClosed++;
+                lock.unlock();
+                idleConnection.connection.reset();
+                lock.lock();
+                continue;
+            }
+
+            numBorrowed++;
+            lock.unlock();
+
+            // the server may have closed the connection while it was idle
+            bool healthy = idleConnection.connection->checkHealth();
+            lock.lock();
+            countHealthCheck(idleConnection.connection->getLastHealthCheck());
+
+            if (!healthy) {
+                try {
+                    checkBackoff(std::chrono::steady_clock::now());
+                }
+                catch (DbError &) {
+                    numBorrowed--;
+                    numClosed++;
+                    available.notify_one();
+                    throw;
+                }
+
+                // restore the connection only after it failed
+                lock.unlock();
+                bool restored = idleConnection.connection->reconnect(true);
+                lock.lock();
+                recordConnectAttempt(restored, std::chrono::steady_clock::now());
+                if (!restored) {
+                    numBorrowed--;
+                    numClosed++;
+                    available.notify_one();
+                    throw DbError("Unable to connect to the database");
+                }
+            }
+            return PooledConnection::Ptr(new PooledConnection(shared_from_this(),
+                        std::move(idleConnection.connection), idleConnection.created));
+        }
+
+        if (numBorrowed < configuration->getDbPoolMaxConnections()) {
+            checkBackoff(std::chrono::steady_clock::now());
+            numBorrowed++;
+            lock.unlock();
+
+            std::unique_ptr<Connection> connection;
+            try {
+                connection.reset(new Connection(configuration));
+            }
+            catch (DbError &) {
+                lock.lock();
+                numBorrowed--;
+                recordConnectAttempt(false, std::chrono::steady_clock::now());
+                available.notify_one();
+                throw;
+            }
+
+            lock.lock();
+            numOpened++;
+            recordConnectAttempt(true, std::chrono::steady_clock::now());
+            lock.unlock();
+            return PooledConnection::Ptr(new PooledConnection(shared_from_this(),
+                        std::move(connection), std::chrono::steady_clock::now()));
+        }
+
+        // all connections are in use
+        numWaiting++;
+        if (waitTimeout == 0) {
+            available.wait(lock);
+        }
+        else if (available.wait_until(lock, deadline) == std::cv_status::timeout) {
+            numWaiting--;
+            if (idle.empty() && (numBorrowed >= configuration->getDbPoolMaxConnections())) {
+                numWaitTimeouts++;
+                throw DbError("Timeout waiting for a database connection. All "
+                            + std::to_string(numBorrowed) + " connections are in use");
+            }
+            continue;
+        }
+        numWaiting--;
+    }
+}
+
+
+void
+ConnectionPool::release(std::unique_ptr<Connection> connection, std::chrono::steady_clock::time_point created)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        numBorrowed--;
+
+        auto now = std::chrono::steady_clock::now();
+        if (connection && !quit && !isExpired(created, now) && (idle.size() < configuration->getDbPoolMaxIdle())) {
+            idle.push_back({std::move(connection), created, now});
+        }
+        else if (connection) {
+            numClosed++;
+        }
+        available.notify_one();
+    }
+
+    // close outside of the lock
+    connection.reset();
+}
+
+
+void
+ConnectionPool::maintain()
+{
+    std::vector<std::unique_ptr<Connection>> closing;
+    size_t numMissing = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto now = std::chrono::steady_clock::now();
+        auto idleTimeout = std::chrono::seconds(configuration->getDbPoolIdleTimeout());
+        size_t minIdle = configuration->getDbPoolMinIdle();
+
+        for (auto it = idle.begin(); it != idle.end();) {
+            // the connections returned first have been idle the longest
+            bool idleTooLong = (idleTimeout.count() > 0) && (now - it->idleSince >= idleTimeout)
+                        && (idle.size() > minIdle);
+            if (idleTooLong || isExpired(it->created, now)) {
+                closing.push_back(std::move(it->connection));
+                it = idle.erase(it);
+                numClosed++;
+            }
+            else {
+                ++it;
+            }
+        }
+
+        size_t numOpen = idle.size() + numBorrowed;
+        size_t maxConnections = configuration->getDbPoolMaxConnections();
+        bool backingOff = (numConsecutiveConnectFailures > 0) && (now < nextConnectAttempt);
+        if ((idle.size() < minIdle) && (numOpen < maxConnections) && !backingOff) {
+            numMissing = std::min(minIdle - idle.size(), maxConnections - numOpen);
+            numBorrowed += numMissing;
+        }
+    }
+
+    if (!closing.empty()) {
+        poco_debug(logger, "Closing " + std::to_string(closing.size()) + " idle connections");
+        closing.clear();
+    }
+
+    // open the missing idle connections in advance. They count as borrowed
+    // while being opened to not exceed the maximum number of connections
+    for (size_t i=0; i<numMissing; i++) {
+        std::unique_ptr<Connection> connection;
+        try {
+            connection.reset(new Connection(configuration));
+        }
+        catch (DbError & e) {
+            poco_warning(logger, std::string("Could not open an idle connection: ") + e.what());
+        }
+
+        bool opened = static_cast<bool>(connection);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (opened) {
+                numOpened++;
+            }
+            recordConnectAttempt(opened, std::chrono::steady_clock::now());
+        }
+
+        // a connection which could not be opened only frees its slot
+        release(std::move(connection), std::chrono::steady_clock::now());
+        if (!opened) {
+            // free the slots of the remaining ones until the next run
+            std::lock_guard<std::mutex> lock(mutex);
+            numBorrowed -= numMissing - i - 1;
+            available.notify_all();
+            break;
+        }
+    }
+}
+
+
+ConnectionPool::Stats
+ConnectionPool::getStats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    Stats stats;
+    stats.numConnections = idle.size() + numBorrowed;
+    stats.numIdle = idle.size();
+    stats.numBorrowed = numBorrowed;
+    stats.numWaiting = numWaiting;
+    stats.maxConnections = configuration->getDbPoolMaxConnections();
+    stats.numOpened = numOpened;
+    stats.numClosed = numClosed;
+    stats.numWaitTimeouts = numWaitTimeouts;
+    stats.numHealthChecksSkipped = numHealthChecksSkipped;
+    stats.numHealthChecksSocket = numHealthChecksSocket;
+    stats.numHealthChecksQuery = numHealthChecksQuery;
+    stats.numConnectAttempts = numConnectAttempts;
+    stats.numConnectFailures = numConnectFailures;
+    stats.numConsecutiveConnectFailures = numConsecutiveConnectFailures;
+    stats.backoffMs = backoff.count();
+    stats.backoffRemainingMs = 0;
+
+    auto now = std::chrono::steady_clock::now();
+    if ((numConsecutiveConnectFailures > 0) && (now < nextConnectAttempt)) {
+        stats.backoffRemainingMs = std::chrono::duration_cast<std::chrono::milliseconds>(nextConnectAttempt - now).count();
+    }
+    return stats;
+}
+
+
+void
+ConnectionPool::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!quit) {
+        quitting.wait_for(lock, std::chrono::milliseconds(SERVER_DB_POOL_MAINTENANCE_INTERVAL));
+        if (quit) {
+            break;
+        }
+        lock.unlock();
+        maintain();
+        lock.lock();
+    }
+}
+
+
+void
+ConnectionPool::stop()
+{
+    std::deque<IdleConnection> closing;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+        numClosed += idle.size();
+        closing.swap(idle);
+        available.notify_all();
+        quitting.notify_all();
+    }
+}
@@ -0,0 +1,197 @@
+#ifndef __batyr_db_connectionpool_h__
+#define __batyr_db_connectionpool_h__
+
+#include <Poco/Logger.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+#include "server/configuration.h"
+#include "server/db/connection.h"
+
+
+namespace Batyr
+{
+namespace Db
+{
+
+    class ConnectionPool; // forward decl
+
+    /**
+     * a connection borrowed from the pool. The connection is returned to
+     * the pool when this object gets destroyed.
+     */
+    class PooledConnection
+    {
+        private:
+            std::shared_ptr<ConnectionPool> pool;
+            std::unique_ptr<Connection> connection;
+            std::chrono::steady_clock::time_point created;
+
+        public:
+            PooledConnection(std::shared_ptr<ConnectionPool> _pool, std::unique_ptr<Connection> _connection,
+                        std::chrono::steady_clock::time_point _created);
+            ~PooledConnection();
+
+            /** disable copying */
+            PooledConnection(const PooledConnection &) = delete;
+            PooledConnection& operator=(const PooledConnection &) = delete;
+
+            Connection & operator*()
+            {
+                return *connection;
+            }
+
+            Connection * operator->()
+            {
+                return connection.get();
+            }
+
+            typedef std::unique_ptr<PooledConnection> Ptr;
+    };
+
+
+    /**
+     * database connections shared by the workers.
+     *
+     * Connections are opened on demand up to the configured maximum. When
+     * all of them are in use, acquire waits until one gets returned. Returned
+     * connections are kept open for reuse - the most recently returned one is
+     * handed out first, so when the load decreases the surplus connections
+     * stay unused and get closed once their idle timeout has passed. As
+     * connections are opened immediately but only closed after the timeout,
+     * bursts of jobs do not cause connections to be closed and opened over
+     * and over again.
+     */
+    class ConnectionPool : public std::enable_shared_from_this<ConnectionPool>
+    {
+        public:
+            struct Stats
+            {
+                size_t numConnections;
+                size_t numIdle;
+                size_t numBorrowed;
+                size_t numWaiting;
+                size_t maxConnections;
+                uint64_t numOpened;
+                uint64_t numClosed;
+                uint64_t numWaitTimeouts;
+
+                /** how the health of borrowed idle connections has been checked */
+                uint64_t numHealthChecksSkipped;
+                uint64_t numHealthChecksSocket;
+                uint64_t numHealthChecksQuery;
+
+                /** attempts to open new or restore broken connections */
+                uint64_t numConnectAttempts;
+                uint64_t numConnectFailures;
+                unsigned int numConsecutiveConnectFailures;
+
+                /** current interval between connect attempts and the time left until the next one */
+                long long backoffMs;
+                long long backoffRemainingMs;
+            };
+
+        private:
+            struct IdleConnection
+            {
+                std::unique_ptr<Connection> connection;
+                std::chrono::steady_clock::time_point created;
+                std::chrono::steady_clock::time_point idleSince;
+            };
+
+            Poco::Logger & logger;
+            Configuration::Ptr configuration;
+
+            std::mutex mutex;
+            std::condition_variable available;
+            std::condition_variable quitting;
+            bool quit;
+
+            /** ordered by the time the connections have been returned */
+            std::deque<IdleConnection> idle;
+
+            size_t numBorrowed;
+            size_t numWaiting;
+            uint64_t numOpened;
+            uint64_t numClosed;
+            uint64_t numWaitTimeouts;
+            uint64_t numHealthChecksSkipped;
+            uint64_t numHealthChecksSocket;
+            uint64_t numHealthChecksQuery;
+            uint64_t numConnectAttempts;
+            uint64_t numConnectFailures;
+            unsigned int numConsecutiveConnectFailures;
+
+            /**
+             * after a failed attempt to connect, no further attempts are made
+             * until this time. The interval doubles with each failure.
+             */
+            std::chrono::milliseconds backoff;
+            std::chrono::steady_clock::time_point nextConnectAttempt;
+
+            /**
+             * the following methods require the mutex to be locked
+             */
+            void countHealthCheck(HealthCheck healthCheck);
+
+            /** throws a DbError while connect attempts are suspended */
+            void checkBackoff(std::chrono::steady_clock::time_point now);
+
+            void recordConnectAttempt(bool success, std::chrono::steady_clock::time_point now);
+
+            bool isExpired(std::chrono::steady_clock::time_point created,
+                        std::chrono::steady_clock::time_point now) const;
+
+            /**
+             * close idle connections which have been unused for longer than
+             * the idle timeout or have reached their maximum lifetime and
+             * open new ones until the minimum number of idle connections
+             * is available.
+             */
+            void maintain();
+
+        public:
+            ConnectionPool(Configuration::Ptr _configuration);
+            ~ConnectionPool();
+
+            /** disable copying */
+            ConnectionPool(const ConnectionPool &) = delete;
+            ConnectionPool& operator=(const ConnectionPool &) = delete;
+
+            /**
+             * borrow a working connection. Throws a DbError when no connection
+             * to the database can be established or the wait timeout expired.
+             */
+            PooledConnection::Ptr acquire();
+
+            /**
+             * return a connection to the pool. Called by PooledConnection.
+             */
+            void release(std::unique_ptr<Connection> connection, std::chrono::steady_clock::time_point created);
+
+            Stats getStats();
+
+            /**
+             * maintain the idle connections until stop gets called. To be
+             * run in a thread of its own.
+             */
+            void run();
+
+            /**
+             * stop run, close all idle connections and let all pending and
+             * future calls to acquire fail
+             */
+            void stop();
+
+            typedef std::shared_ptr<ConnectionPool> Ptr;
+    };
+
+};
+};
+
+#endif // __batyr_db_connectionpool_h__
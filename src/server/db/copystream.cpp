@@ -0,0 +1,110 @@
+#include <cstdlib>
+
+#include "server/db/copystream.h"
+#include "server/db/connection.h"
+
+
+using namespace Batyr::Db;
+
+
+CopyStream::CopyStream(Transaction & _transaction, const std::string & copySql, size_t _flushThreshold)
+    :   transaction(_transaction),
+        flushThreshold(_flushThreshold),
+        finished(false),
+        rowStarted(false)
+{
+    buffer.reserve(flushThreshold);
+    transaction.beginCopy(copySql);
+}
+
+
+CopyStream::~CopyStream()
+{
+    if (!finished) {
+        // the server reports the aborted COPY as an error which
+        // is of no interest here as the cause is already known
+        try {
+            transaction.endCopy("aborted by batyr");
+        }
+        catch (DbError &e) {}
+    }
+}
+
+
+void
+CopyStream::write(const char * data, size_t length)
+{
+    buffer.append(data, length);
+    if (buffer.size() >= flushThreshold) {
+        flush();
+    }
+}
+
+
+void
+CopyStream::writeTextValue(const QueryValue & value)
+{
+    if (rowStarted) {
+        buffer.push_back('\t');
+    }
+    rowStarted = true;
+
+    if (value.isNull()) {
+        buffer.append("\\N");
+        return;
+    }
+
+    // escape the characters which have a special meaning in the text format
+    // see http://www.postgresql.org/docs/current/static/sql-copy.html
+    for (const char c : value.getRef()) {
+        switch (c) {
+            case '\\':
+                buffer.append("\\\\");
+                break;
+            case '\n':
+                buffer.append("\\n");
+                break;
+            case '\r':
+                buffer.append("\\r");
+                break;
+            case '\t':
+                buffer.append("\\t");
+                break;
+            default:
+                buffer.push_back(c);
+        }
+    }
+}
+
+
+void
+CopyStream::endTextRow()
+{
+    buffer.push_back('\n');
+    rowStarted = false;
+
+    if (buffer.size() >= flushThreshold) {
+        flush();
+    }
+}
+
+
+void
+CopyStream::flush()
+{
+    if (!buffer.empty()) {
+        transaction.putCopyData(buffer.data(), static_cast<int>(buffer.size()));
+        buffer.clear();
+    }
+}
+
+
+int
+CopyStream::finish()
+{
+    flush();
+    finished = true;
+
+    auto res = transaction.endCopy();
+    return std::atoi(PQcmdTuples(res.get()));
+}
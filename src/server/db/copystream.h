@@ -0,0 +1,78 @@
+#ifndef __batyr_db_copystream_h__
+#define __batyr_db_copystream_h__
+
+#include <string>
+
+#include "server/db/transaction.h"
+#include "server/db/queryvalue.h"
+
+
+namespace Batyr
+{
+namespace Db
+{
+
+    /**
+     * streams rows to the database using "COPY ... FROM STDIN".
+     *
+     * The rows are collected in a buffer which is send to the server
+     * each time it grows beyond the flushThreshold. A stream which
+     * is destroyed without calling finish aborts the COPY.
+     */
+    class CopyStream
+    {
+        private:
+            Transaction & transaction;
+            std::string buffer;
+
+            /**
+             * size of the buffer in bytes which triggers sending it
+             * to the server
+             */
+            size_t flushThreshold;
+
+            bool finished;
+
+            /** the current row has at least one column */
+            bool rowStarted;
+
+        public:
+            CopyStream(Transaction & _transaction, const std::string & copySql, size_t _flushThreshold);
+            ~CopyStream();
+
+            /** disable copying */
+            CopyStream(const CopyStream &) = delete;
+            CopyStream& operator=(const CopyStream &) = delete;
+
+            /**
+             * append raw data to the stream
+             */
+            void write(const char * data, size_t length);
+
+            /**
+             * append a value to the current row using the text format of COPY
+             */
+            void writeTextValue(const QueryValue & value);
+
+            /**
+             * terminate the current row in the text format
+             */
+            void endTextRow();
+
+            /**
+             * send the buffered data to the server
+             */
+            void flush();
+
+            /**
+             * send the remaining data and complete the COPY.
+             *
+             * returns the number of rows the server received
+             */
+            int finish();
+    };
+
+};
+};
+
+#endif // __batyr_db_copystream_h__
@@ -26,6 +26,15 @@ namespace Db
 
         /** column is part of the primary key */
         bool isPrimaryKey;
+
+        /** column is defined as "not null" */
+        bool isNotNull;
+
+        /**
+         * values of the column can be compressed or stored out of line
+         * (TOAST). False for fixed-length types.
+         */
+        bool isToastable;
     };
 
     typedef std::map<std::string, Field> FieldMap;
@@ -0,0 +1,160 @@
+#include "server/db/metadatacache.h"
+
+
+using namespace Batyr::Db;
+
+
+MetadataCache::MetadataCache(Configuration::Ptr _configuration)
+    :   logger(Poco::Logger::get("Db::MetadataCache")),
+        configuration(_configuration),
+        generation(0),
+        numHits(0),
+        numMisses(0),
+        numInvalidations(0)
+{
+}
+
+
+template<typename K, typename V, typename F>
+V
+MetadataCache::get(std::map<K, Entry<V>> & entries, const K & key, F fetch)
+{
+    auto ttl = std::chrono::seconds(configuration->getMetadataCacheTtl());
+    uint64_t fetchGeneration;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(key);
+        if ((it != entries.end()) && (std::chrono::steady_clock::now() < it->second.expires)) {
+            numHits++;
+            return it->second.value;
+        }
+        numMisses++;
+        fetchGeneration = generation;
+    }
+
+    // the catalogs are queried without holding the lock to
+    // not block the other workers
+    V value = fetch();
+
+    if (ttl.count() > 0) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (fetchGeneration == generation) {
+            entries[key] = {value, std::chrono::steady_clock::now() + ttl};
+        }
+    }
+    return value;
+}
+
+
+FieldMap
+MetadataCache::getTableFields(Transaction & transaction, const std::string & target,
+            const std::string & tableSchema, const std::string & tableName)
+{
+    return get(tableFields, TableKey(target, tableSchema, tableName), [&]() {
+        return transaction.getTableFields(tableSchema, tableName);
+    });
+}
+
+
+bool
+MetadataCache::findTableFields(const std::string & target, const std::string & tableSchema,
+            const std::string & tableName, FieldMap & fields)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = tableFields.find(TableKey(target, tableSchema, tableName));
+    if ((it == tableFields.end()) || (std::chrono::steady_clock::now() >= it->second.expires)) {
+        return false;
+    }
+    numHits++;
+    fields = it->second.value;
+    return true;
+}
+
+
+int
+MetadataCache::getGeometryColumnSRID(Transaction & transaction, const std::string & target,
+            const std::string & tableSchema, const std::string & tableName,
+            const std::string & columnName)
+{
+    auto key = std::make_pair(TableKey(target, tableSchema, tableName), columnName);
+    return get(geometryColumnSrids, key, [&]() {
+        return PostGis::getGeometryColumnSRID(transaction, tableSchema, tableName, columnName);
+    });
+}
+
+
+PostGis::VersionTuple
+MetadataCache::getPostgisVersion(Transaction & transaction, const std::string & target)
+{
+    return get(postgisVersions, target, [&]() {
+        return PostGis::getVersion(transaction);
+    });
+}
+
+
+size_t
+MetadataCache::invalidateTable(const std::string & tableSchema, const std::string & tableName)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    generation++;
+    numInvalidations++;
+
+    auto matches = [&](const TableKey & key) {
+        return (std::get<1>(key) == tableSchema) && (std::get<2>(key) == tableName);
+    };
+
+    size_t numRemoved = 0;
+    for (auto it = tableFields.begin(); it != tableFields.end();) {
+        if (matches(it->first)) {
+            it = tableFields.erase(it);
+            numRemoved++;
+        }
+        else {
+            ++it;
+        }
+    }
+    for (auto it = geometryColumnSrids.begin(); it != geometryColumnSrids.end();) {
+        if (matches(it->first.first)) {
+            it = geometryColumnSrids.erase(it);
+            numRemoved++;
+        }
+        else {
+            ++it;
+        }
+    }
+
+    poco_debug(logger, "Removed " + std::to_string(numRemoved) + " cached entries of table "
+                + tableSchema + "." + tableName);
+    return numRemoved;
+}
+
+
+size_t
+MetadataCache::invalidateAll()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    generation++;
+    numInvalidations++;
+
+    size_t numRemoved = tableFields.size() + geometryColumnSrids.size() + postgisVersions.size();
+    tableFields.clear();
+    geometryColumnSrids.clear();
+    postgisVersions.clear();
+
+    poco_debug(logger, "Removed all " + std::to_string(numRemoved) + " cached entries");
+    return numRemoved;
+}
+
+
+MetadataCache::Stats
+MetadataCache::getStats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    Stats stats;
+    stats.numHits = numHits;
+    stats.numMisses = numMisses;
+    stats.numInvalidations = numInvalidations;
+    stats.numEntries = tableFields.size() + geometryColumnSrids.size() + postgisVersions.size();
+    return stats;
+}
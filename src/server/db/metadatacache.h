@@ -0,0 +1,133 @@
+#ifndef __batyr_db_metadatacache_h__
+#define __batyr_db_metadatacache_h__
+
+#include <Poco/Logger.h>
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <utility>
+
+#include "server/configuration.h"
+#include "server/db/connection.h"
+#include "server/db/field.h"
+#include "server/db/postgis.h"
+
+
+namespace Batyr
+{
+namespace Db
+{
+
+    /**
+     * catalog metadata of the target tables shared by all workers.
+     *
+     * Looking up the columns of a table, the SRID of its geometry column and
+     * the version of postgis takes several queries on the system catalogs for
+     * each job - for small pulls most of the time of the job. The results are
+     * kept for the configured TTL. As changes to the structure of a table made
+     * by other clients are not noticed before, entries are removed early by
+     * the workers when a statement failed because of such a change and by
+     * the invalidate-metadata-cache endpoint of the HTTP API.
+     *
+     * Entries are keyed by the target of the connection (see
+     * Connection::getTarget) so multiple databases do not share them.
+     */
+    class MetadataCache
+    {
+        public:
+            struct Stats
+            {
+                uint64_t numHits;
+                uint64_t numMisses;
+                uint64_t numInvalidations;
+                size_t numEntries;
+            };
+
+        private:
+            template<typename T>
+            struct Entry
+            {
+                T value;
+                std::chrono::steady_clock::time_point expires;
+            };
+
+            /** target, schema, table */
+            typedef std::tuple<std::string, std::string, std::string> TableKey;
+
+            Poco::Logger & logger;
+            Configuration::Ptr configuration;
+
+            std::mutex mutex;
+            std::map<TableKey, Entry<FieldMap>> tableFields;
+            std::map<std::pair<TableKey, std::string>, Entry<int>> geometryColumnSrids;
+            std::map<std::string, Entry<PostGis::VersionTuple>> postgisVersions;
+
+            /**
+             * incremented on every invalidation. Values fetched while an
+             * invalidation happened are not stored as they may be outdated
+             * already.
+             */
+            uint64_t generation;
+
+            uint64_t numHits;
+            uint64_t numMisses;
+            uint64_t numInvalidations;
+
+            /**
+             * return the cached value or fetch it - without holding the
+             * lock - and store it
+             */
+            template<typename K, typename V, typename F>
+            V get(std::map<K, Entry<V>> & entries, const K & key, F fetch);
+
+        public:
+            MetadataCache(Configuration::Ptr _configuration);
+
+            /** disable copying */
+            MetadataCache(const MetadataCache &) = delete;
+            MetadataCache& operator=(const MetadataCache &) = delete;
+
+            /** cached Transaction::getTableFields */
+            FieldMap getTableFields(Transaction & transaction, const std::string & target,
+                        const std::string & tableSchema, const std::string & tableName);
+
+            /**
+             * the cached columns of a table without querying the catalogs.
+             * Returns false when they are not cached.
+             */
+            bool findTableFields(const std::string & target, const std::string & tableSchema,
+                        const std::string & tableName, FieldMap & fields);
+
+            /** cached PostGis::getGeometryColumnSRID */
+            int getGeometryColumnSRID(Transaction & transaction, const std::string & target,
+                        const std::string & tableSchema, const std::string & tableName,
+                        const std::string & columnName);
+
+            /** cached PostGis::getVersion */
+            PostGis::VersionTuple getPostgisVersion(Transaction & transaction, const std::string & target);
+
+            /**
+             * remove the entries of a table of all targets.
+             * Returns the number of removed entries.
+             */
+            size_t invalidateTable(const std::string & tableSchema, const std::string & tableName);
+
+            /**
+             * remove all entries. Returns the number of removed entries.
+             */
+            size_t invalidateAll();
+
+            Stats getStats();
+
+            typedef std::shared_ptr<MetadataCache> Ptr;
+    };
+
+};
+};
+
+#endif // __batyr_db_metadatacache_h__
@@ -15,7 +15,8 @@ using namespace Batyr::Db;
 Transaction::Transaction(Connection * _connection)
     :   logger(Poco::Logger::get("Db::Transaction")),
         connection(_connection),
-        rollback(false)
+        rollback(false),
+        failed(false)
 {
     poco_debug(logger, "BEGIN");
 
@@ -26,8 +27,10 @@ Transaction::Transaction(Connection * _connection)
 
 Transaction::~Transaction()
 {
+    abortPipeline();
+
     auto transactionStatus = PQtransactionStatus(connection->pgconn);
-    if (rollback || (transactionStatus == PQTRANS_INERROR) || (transactionStatus == PQTRANS_UNKNOWN)) {
+    if (rollback || failed || (transactionStatus == PQTRANS_INERROR) || (transactionStatus == PQTRANS_UNKNOWN)) {
         poco_debug(logger, "ROLLBACK");
         exec("rollback;");
     }
@@ -47,6 +50,11 @@ Transaction::~Transaction()
         }
     }
     exitSqls.clear();
+
+    // spares the health check of the connection when it gets used again soon
+    if (PQstatus(connection->pgconn) == CONNECTION_OK) {
+        connection->markUsed();
+    }
 }
 
 
@@ -115,9 +123,16 @@ PGresultPtr
 Transaction::execPrepared(const std::string &stmtName, const std::vector<QueryValue> &qValues)
 {
     // convert to an array of c strings
-    auto params = PGParams(qValues);
+    PGParams params(qValues);
 
-    PGresultPtr result = this->execPrepared(stmtName, params.length(), params.values(), params.valueLenghts(), NULL, 1);
+    return execPrepared(stmtName, params);
+}
+
+
+PGresultPtr
+Transaction::execPrepared(const std::string &stmtName, PGParams &params)
+{
+    PGresultPtr result = this->execPrepared(stmtName, params.length(), params.values(), params.valueLenghts(), params.formats(), 1);
 
     return std::move(result);
 }
@@ -127,43 +142,258 @@ PGresultPtr
 Transaction::execParams(const std::string &_sql, const std::vector<QueryValue> &qValues)
 {
     // convert to an array of c strings
-    auto params = PGParams(qValues);
+    PGParams params(qValues);
 
     PGresultPtr result = this->execParams(_sql, params.length(), NULL, params.values(), params.valueLenghts(), NULL, 1);
 
     return std::move(result);
 }
 
+void
+Transaction::beginCopy(const std::string &_sql)
+{
+    PGresultPtr result( PQexec(connection->pgconn, _sql.c_str()), PQclear);
+    checkResult(result);
+
+    if (PQresultStatus(result.get()) != PGRES_COPY_IN) {
+        failed = true;
+        throw DbError("query did not start a COPY FROM STDIN: " + _sql);
+    }
+}
+
+
+void
+Transaction::putCopyData(const char * buffer, int nBytes)
+{
+    // the connection is blocking, so -1 is the only failure which may occur here
+    if (PQputCopyData(connection->pgconn, buffer, nBytes) != 1) {
+        std::string msg = "sending COPY data failed: " + std::string(PQerrorMessage(connection->pgconn));
+        poco_error(logger, msg.c_str());
+        failed = true;
+        throw DbError(msg);
+    }
+}
+
+
+PGresultPtr
+Transaction::endCopy(const char * errorMessage)
+{
+    if (PQputCopyEnd(connection->pgconn, errorMessage) != 1) {
+        std::string msg = "ending COPY failed: " + std::string(PQerrorMessage(connection->pgconn));
+        poco_error(logger, msg.c_str());
+        failed = true;
+        throw DbError(msg);
+    }
+
+    PGresultPtr result( PQgetResult(connection->pgconn), PQclear);
+
+    // consume the rest of the results to get the connection
+    // ready for the next command
+    while (auto pendingRes = PQgetResult(connection->pgconn)) {
+        PQclear(pendingRes);
+    }
+
+    checkResult(result);
+    return std::move(result);
+}
+
+
 void
 Transaction::checkResult(PGresultPtr & res)
 {
     if (!res) {
         std::string msg = "query result was null: " + std::string(PQerrorMessage(connection->pgconn));
         poco_error(logger, msg.c_str());
-        rollback = true;
+        failed = true;
         throw DbError(msg);
     }
 
     auto resStatus = PQresultStatus(res.get());
     if (resStatus == PGRES_FATAL_ERROR) {
-        char * sqlstate = PQresultErrorField(res.get(), PG_DIAG_SQLSTATE);
-        char * msg_primary = PQresultErrorField(res.get(), PG_DIAG_MESSAGE_PRIMARY);
-        char * context = PQresultErrorField(res.get(), PG_DIAG_CONTEXT);
+        failed = true;
+        throw errorFromResult(res.get());
+    }
+}
+
+
+DbError
+Transaction::errorFromResult(const PGresult * res)
+{
+    char * sqlstate = PQresultErrorField(res, PG_DIAG_SQLSTATE);
+    char * msg_primary = PQresultErrorField(res, PG_DIAG_MESSAGE_PRIMARY);
+    char * context = PQresultErrorField(res, PG_DIAG_CONTEXT);
+
+    // errors created by libpq itself have no sqlstate and no primary message
+    std::string msg = (msg_primary != nullptr) ? msg_primary : PQresultErrorMessage(res);
 
 #ifdef _DEBUG
-        std::stringstream msgstream;
-        msgstream << "query failed: " << msg_primary << " [sqlstate: " << sqlstate << "]";
-        poco_debug(logger, msgstream.str().c_str());
+    std::stringstream msgstream;
+    msgstream << "query failed: " << msg << " [sqlstate: " << (sqlstate != nullptr ? sqlstate : "") << "]";
+    poco_debug(Poco::Logger::get("Db::Transaction"), msgstream.str().c_str());
+#endif
+
+    auto excep = DbError(msg, (sqlstate != nullptr) ? sqlstate : "");
+    if (context != nullptr) {
+        excep.setContext(context);
+    }
+    return excep;
+}
+
+
+void
+Transaction::savepoint(const std::string &name)
+{
+    exec("savepoint " + name);
+}
+
+
+void
+Transaction::releaseSavepoint(const std::string &name)
+{
+    exec("release savepoint " + name);
+}
+
+
+void
+Transaction::rollbackToSavepoint(const std::string &name)
+{
+    exec("rollback to savepoint " + name);
+
+    // the failure has been undone, the transaction may be commited
+    failed = false;
+}
+
+
+bool
+Transaction::supportsPipelineMode()
+{
+#ifdef HAVE_PQ_PIPELINE_MODE
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+void
+Transaction::enterPipelineMode()
+{
+#ifdef HAVE_PQ_PIPELINE_MODE
+    if (PQenterPipelineMode(connection->pgconn) != 1) {
+        std::string msg = "entering pipeline mode failed: " + std::string(PQerrorMessage(connection->pgconn));
+        poco_error(logger, msg.c_str());
+        throw DbError(msg);
+    }
+#else
+    throw DbError("batyr was build without support for the pipeline mode of libpq");
 #endif
+}
+
 
-        rollback = true;
+void
+Transaction::exitPipelineMode()
+{
+#ifdef HAVE_PQ_PIPELINE_MODE
+    if (PQexitPipelineMode(connection->pgconn) != 1) {
+        std::string msg = "leaving pipeline mode failed: " + std::string(PQerrorMessage(connection->pgconn));
+        poco_error(logger, msg.c_str());
+        failed = true;
+        throw DbError(msg);
+    }
+#endif
+}
 
-        auto excep = DbError(msg_primary, sqlstate);
-        if (context != nullptr) {
-            excep.setContext(context);
+
+void
+Transaction::abortPipeline()
+{
+#ifdef HAVE_PQ_PIPELINE_MODE
+    if (PQpipelineStatus(connection->pgconn) == PQ_PIPELINE_OFF) {
+        return;
+    }
+    poco_debug(logger, "Discarding pending pipeline results");
+    failed = true;
+
+    PQpipelineSync(connection->pgconn);
+
+    // PQexitPipelineMode only succeeds when all results have been consumed.
+    // Give up when the connection does not provide any more results
+    // as this means it is broken.
+    int numNullResults = 0;
+    while ((PQexitPipelineMode(connection->pgconn) != 1) && (numNullResults < 2)) {
+        auto res = PQgetResult(connection->pgconn);
+        if (res == nullptr) {
+            numNullResults++;
+        }
+        else {
+            numNullResults = 0;
+            PQclear(res);
         }
-        throw excep;
     }
+#endif
+}
+
+
+void
+Transaction::sendQuery(const std::string &_sql)
+{
+    // PQsendQuery does not support the pipeline mode
+    if (PQsendQueryParams(connection->pgconn, _sql.c_str(), 0, NULL, NULL, NULL, NULL, 1) != 1) {
+        std::string msg = "sending query failed: " + std::string(PQerrorMessage(connection->pgconn));
+        poco_error(logger, msg.c_str());
+        failed = true;
+        throw DbError(msg);
+    }
+}
+
+
+void
+Transaction::sendPrepared(const std::string &stmtName, PGParams &params)
+{
+    if (PQsendQueryPrepared(connection->pgconn, stmtName.c_str(), params.length(), params.values(),
+                params.valueLenghts(), params.formats(), 1) != 1) {
+        std::string msg = "sending prepared statement failed: " + std::string(PQerrorMessage(connection->pgconn));
+        poco_error(logger, msg.c_str());
+        failed = true;
+        throw DbError(msg);
+    }
+}
+
+
+void
+Transaction::pipelineSync()
+{
+#ifdef HAVE_PQ_PIPELINE_MODE
+    if (PQpipelineSync(connection->pgconn) != 1) {
+        std::string msg = "pipeline synchronization failed: " + std::string(PQerrorMessage(connection->pgconn));
+        poco_error(logger, msg.c_str());
+        failed = true;
+        throw DbError(msg);
+    }
+#endif
+}
+
+
+PGresultPtr
+Transaction::getPipelineResult()
+{
+    PGresultPtr result( PQgetResult(connection->pgconn), PQclear);
+    if (!result) {
+        std::string msg = "expected a pipeline result: " + std::string(PQerrorMessage(connection->pgconn));
+        poco_error(logger, msg.c_str());
+        failed = true;
+        throw DbError(msg);
+    }
+
+#ifdef HAVE_PQ_PIPELINE_MODE
+    if (PQresultStatus(result.get()) != PGRES_PIPELINE_SYNC) {
+        // the results of each query are terminated by a null result
+        while (auto pendingRes = PQgetResult(connection->pgconn)) {
+            PQclear(pendingRes);
+        }
+    }
+#endif
+    return std::move(result);
 }
 
 void
@@ -201,6 +431,24 @@ Transaction::createTempTable(const std::string &existingTableSchema, const std::
 }
 
 
+void
+Transaction::createTempTable(const std::string &tempTableName, const std::vector<std::string> &columnDefinitions)
+{
+    poco_debug(logger, "creating table " + tempTableName);
+    std::string qTempTableName = quoteIdent(tempTableName);
+
+    std::stringstream querystream;
+    querystream << "create temporary table " << qTempTableName
+                << " (" << StringUtils::join(columnDefinitions, ", ") << ")";
+
+    std::stringstream dropTableStream;
+    dropTableStream << "drop table if exists " << qTempTableName;
+    exitSqls.push_back(dropTableStream.str());
+
+    exec(querystream.str());
+}
+
+
 FieldMap
 Transaction::getTableFields(const std::string &tableSchema, const std::string &tableName)
 {
@@ -215,7 +463,8 @@ Transaction::getTableFields(const std::string &tableSchema, const std::string &t
             static_cast<int>(tableSchema.length())
     };
     auto res = execParams(
-                "select pa.attname, pt.typname, pt.oid, coalesce(is_pk.is_pk, 'N')::text as is_pk"
+                "select pa.attname, pt.typname, pt.oid, coalesce(is_pk.is_pk, 'N')::text as is_pk, pa.attnotnull::text,"
+                "   (pa.attstorage <> 'p')::text as is_toastable"
                 " from pg_catalog.pg_attribute pa"
                 " join pg_catalog.pg_class pc on pc.oid=pa.attrelid and pa.attnum>0"
                 " join pg_catalog.pg_namespace pns on pc.relnamespace = pns.oid"
@@ -233,6 +482,8 @@ Transaction::getTableFields(const std::string &tableSchema, const std::string &t
         char * typname = PQgetvalue(res.get(), i, 1);
         char * oid = PQgetvalue(res.get(), i, 2);
         char * isPk = PQgetvalue(res.get(), i, 3);
+        char * notNull = PQgetvalue(res.get(), i, 4);
+        char * isToastable = PQgetvalue(res.get(), i, 5);
 
         auto field = &fieldMap[attname];
         if (!field->name.empty()) {
@@ -243,66 +494,47 @@ Transaction::getTableFields(const std::string &tableSchema, const std::string &t
         field->pgTypeName = typname;
         field->pgTypeOid = std::atoi(oid);
         field->isPrimaryKey = (std::strcmp(isPk,"Y") == 0);
+        field->isNotNull = (std::strcmp(notNull,"true") == 0);
+        field->isToastable = (std::strcmp(isToastable,"true") == 0);
     }
     return std::move(fieldMap);
 }
 
 
-std::vector<std::string> 
-Transaction::quoteIdent(const std::vector<std::string> & inStrings)
+/**
+ * quote an identifier the same way PQescapeIdentifier does: enclose it in
+ * double quotes and double the double quotes it contains. The client
+ * encoding of the connections is always UTF8, which is safe to process
+ * bytewise as all bytes of multibyte characters have the high bit set.
+ */
+static std::string
+quoteIdentifier(const std::string & identifier)
 {
-    std::vector<std::string> quotedStrings;
-    size_t inStringsSize = inStrings.size();
-
-    if (inStringsSize > 0) {
-#ifdef HAVE_PQ_ESCAPE_IDENTIFIER
-        for(auto &inString: inStrings) {
-            char * escaped = PQescapeIdentifier(connection->pgconn, inString.c_str(), 
-                        inString.length());
-            if (escaped != nullptr) {
-                quotedStrings.push_back(std::string(escaped));
-                PQfreemem(escaped);
-            }
-            else {
-                std::string msg = "quoting sql identifier <" + inString 
-                            + "> failed: " + std::string(PQerrorMessage(connection->pgconn));
-                poco_error(logger, msg.c_str());
-                throw DbError(msg);
-            }
-        }
-#else
-        std::stringstream queryStrm;
-
-        size_t iParam = 0;
-        std::vector<const char *> paramValues;
-        paramValues.reserve(inStringsSize);
-        std::vector<int> paramLengths;
-        paramLengths.reserve(inStringsSize);
-
-        queryStrm << "select ";
-        while (iParam < inStringsSize) {
-            if (iParam > 0) {
-                queryStrm << ", ";
-            }
-            queryStrm << "quote_ident($" << iParam+1 << ")";
-            paramValues.push_back(inStrings[iParam].c_str());
-            paramLengths.push_back(inStrings[iParam].length());
-            ++iParam;
-        }
-
-        auto res = execParams(
-                queryStrm.str(),
-                paramValues.size(), NULL, &paramValues[0], &paramLengths[0], NULL, 1);
+    if (identifier.find('\0') != std::string::npos) {
+        throw DbError("quoting sql identifier <" + identifier + "> failed: identifiers may not contain null bytes");
+    }
 
-        if (PQntuples(res.get()) != 1) {
-            throw DbError("Transaction::quoteIdent should only get one tuple from db");
+    std::string quoted;
+    quoted.reserve(identifier.size() + 2);
+    quoted.push_back('"');
+    for (char c : identifier) {
+        if (c == '"') {
+            quoted.push_back('"');
         }
+        quoted.push_back(c);
+    }
+    quoted.push_back('"');
+    return quoted;
+}
 
-        for (size_t i=0; i < inStringsSize; i++) {
-            char * val = PQgetvalue(res.get(), 0, i);
-            quotedStrings.push_back(std::string(val));
-        }
-#endif
+
+std::vector<std::string> 
+Transaction::quoteIdent(const std::vector<std::string> & inStrings)
+{
+    std::vector<std::string> quotedStrings;
+    quotedStrings.reserve(inStrings.size());
+    for (const auto & inString : inStrings) {
+        quotedStrings.push_back(quoteIdentifier(inString));
     }
     return quotedStrings;
 }
@@ -311,67 +543,87 @@ Transaction::quoteIdent(const std::vector<std::string> & inStrings)
 std::string 
 Transaction::quoteIdent(const std::string & uq1)
 {
-    std::vector<std::string> uqv;
-    uqv.push_back(uq1);
-    
-    auto qv = quoteIdent(uqv);
-    if (qv.size() != 1) {
-        throw DbError("Quoted vector should contain excatly one element.");
-    }
-    return qv[0];
+    return quoteIdentifier(uq1);
 }
 
 
 std::string
 Transaction::quoteAndJoinIdent(const std::string & uq1, const std::string & uq2)
 {
-    std::vector<std::string> uqv;
-    uqv.push_back(uq1);
-    uqv.push_back(uq2);
-    
-    auto qv = quoteIdent(uqv);
-    if (qv.size() != 2) {
-        throw DbError("Quoted vector should contain exactly two elements.");
-    }
-    return StringUtils::join(qv, ".");
+    return quoteIdentifier(uq1) + "." + quoteIdentifier(uq2);
 }
 
 
 PGParams::PGParams(const std::vector<QueryValue> &qValues) 
-    :   _values(NULL),
-        _valueLengths(NULL),
-        _length(0)
 {
-    _length = qValues.size();
-    _values = new char *[_length];
-    _valueLengths = new int [_length];
+    add(qValues);
+}
+
+
+void
+PGParams::clear()
+{
+    _values.clear();
+    _valueLengths.clear();
+    _formats.clear();
+}
+
 
-    int i = 0;
+void
+PGParams::reserve(size_t n)
+{
+    _values.reserve(n);
+    _valueLengths.reserve(n);
+    _formats.reserve(n);
+}
+
+
+void
+PGParams::add(const QueryValue &qValue)
+{
+    if (qValue.isNull()) {
+        _values.push_back(NULL);
+        _valueLengths.push_back(0);
+    }
+    else {
+        const auto & v = qValue.getRef();
+        _values.push_back(v.c_str());
+        _valueLengths.push_back(static_cast<int>(v.length()));
+    }
+    _formats.push_back(0); // text
+}
+
+
+void
+PGParams::add(const std::vector<QueryValue> &qValues)
+{
+    reserve(_values.size() + qValues.size());
     for (auto const &pV: qValues) {
-        if (pV.isNull()) {
-            _values[i] = NULL;
-            _valueLengths[i] = 0;
-        }
-        else {
-            auto v = pV.get();
-            _values[i] = strdup(v.c_str());
-            _valueLengths[i] = static_cast<int>(v.length());
-        }
-        i++;
+        add(pV);
     }
 }
 
-PGParams::~PGParams()
+
+void
+PGParams::setBinary(int index, const char * data, int dataLength)
 {
-    if (_values != NULL) {
-        for(int i = 0; i<_length; i++) {
-            if (_values[i] != NULL) {
-                free(_values[i]);
-            }
-        }
-        delete[] _values;
+    if ((index < 0) || (index >= length())) {
+        throw DbError("PGParams: parameter index out of range");
     }
-    if (_valueLengths != NULL) {
-        delete[] _valueLengths;
+    _values[index] = data;
+    _valueLengths[index] = dataLength;
+    _formats[index] = 1; // binary
+}
+
+
+void
+Transaction::consumePipelineSync()
+{
+    auto res = getPipelineResult();
+#ifdef HAVE_PQ_PIPELINE_MODE
+    if (PQresultStatus(res.get()) != PGRES_PIPELINE_SYNC) {
+        failed = true;
+        throw DbError("expected a pipeline synchronization point, got a query result");
     }
+#endif
 }
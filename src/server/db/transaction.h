@@ -18,6 +18,8 @@ namespace Db
 {
  
     class Connection; // forward decl;
+    class DbError; // forward decl;
+    class PGParams; // forward decl;
 
     /** 
      * smartpointer to free a PGresult on scope exit
@@ -46,11 +48,22 @@ namespace Db
              */
             bool rollback;
 
+            /**
+             * a query of this transaction failed. Reset when the
+             * transaction is rolled back to a savepoint
+             */
+            bool failed;
+
             /**
              * check a PQresult if it was a scuccessfull
              * or throw a meaningful DbError
              **/
             void checkResult(PGresultPtr & res);
+
+            /**
+             * leave the pipeline mode discarding all pending results
+             */
+            void abortPipeline();
             
 
         public:
@@ -69,6 +82,21 @@ namespace Db
             PGresultPtr execPrepared(const std::string &stmtName, int nParams, const char * const *paramValues, const int *paramLengths,
                         const int *paramFormats, int resultFormat);
             PGresultPtr execPrepared(const std::string &stmtName, const std::vector<QueryValue> &qValues);
+            PGresultPtr execPrepared(const std::string &stmtName, PGParams &params);
+
+            /**
+             * start a "COPY ... FROM STDIN" command. The data has to be send
+             * using putCopyData and the command has to be completed by calling
+             * endCopy before any other query can be executed.
+             */
+            void beginCopy(const std::string &_sql);
+            void putCopyData(const char * buffer, int nBytes);
+
+            /**
+             * complete a running COPY command. When an errorMessage is given,
+             * the COPY will be aborted and fail with this message.
+             */
+            PGresultPtr endCopy(const char * errorMessage = nullptr);
 
 
             void discard()
@@ -76,6 +104,53 @@ namespace Db
                 rollback = true;
             }
 
+            /**
+             * savepoints to recover from failed queries without
+             * discarding the whole transaction
+             */
+            void savepoint(const std::string &name);
+            void releaseSavepoint(const std::string &name);
+            void rollbackToSavepoint(const std::string &name);
+
+            /**
+             * build a DbError from a result with the status PGRES_FATAL_ERROR
+             */
+            static DbError errorFromResult(const PGresult * res);
+
+            /**
+             * check if the pipeline mode of libpq is supported. This requires
+             * batyr to be build against libpq 14 or later.
+             */
+            static bool supportsPipelineMode();
+
+            /**
+             * In pipeline mode queries are send to the server without waiting
+             * for their results. The results have to be collected in the order
+             * of the queries using getPipelineResult after calling pipelineSync.
+             *
+             * When a query fails, all following queries until the next
+             * pipelineSync will be skipped by the server and return
+             * PGRES_PIPELINE_ABORTED.
+             */
+            void enterPipelineMode();
+            void exitPipelineMode();
+            void sendQuery(const std::string &_sql);
+            void sendPrepared(const std::string &stmtName, PGParams &params);
+            void pipelineSync();
+
+            /**
+             * get the result of the next query in the pipeline or
+             * PGRES_PIPELINE_SYNC for a synchronization point.
+             *
+             * The result is not checked for errors.
+             */
+            PGresultPtr getPipelineResult();
+
+            /**
+             * consume the result of a synchronization point in the pipeline
+             */
+            void consumePipelineSync();
+
             /**
              * Create a temporary table based upon the schema
              * of an existing table;
@@ -84,51 +159,97 @@ namespace Db
              */
             void createTempTable(const std::string &existingTableSchema, const std::string &existingTableName, const std::string &tempTableName); 
 
+            /**
+             * Create a temporary table using the given column definitions.
+             * The definitions are expected to be already quoted.
+             *
+             * The table will be dropped when the Transsction object is destroyed.
+             */
+            void createTempTable(const std::string &tempTableName, const std::vector<std::string> &columnDefinitions);
+
             /**
              * Return a FieldMap describing the columns of the given table.
              */
             FieldMap getTableFields(const std::string &tableSchema, const std::string &tableName);
 
             /** 
-             * quote all strings of the vector as identifiers using 
-             * postgresqls quote_ident function
+             * quote all strings of the vector as identifiers. This happens
+             * locally without querying the server.
              */
-            std::vector<std::string> quoteIdent(const std::vector<std::string> &);
-            std::string quoteIdent(const std::string &);
+            static std::vector<std::string> quoteIdent(const std::vector<std::string> &);
+            static std::string quoteIdent(const std::string &);
 
             /**
-             * return the value quoted with quote_ident and all parts joined together with a '.'
+             * return the values quoted as identifiers and joined together with a '.'
              */
-            std::string quoteAndJoinIdent(const std::string &, const std::string &);
+            static std::string quoteAndJoinIdent(const std::string &, const std::string &);
 
     };
 
 
-    /** RAI helper to create C arrays with parameters for libpq functions */
+    /**
+     * helper to create the C arrays with parameters for libpq functions.
+     *
+     * The values are not copied, they reference the strings of the
+     * QueryValues which have to stay valid and unchanged as long as
+     * this object is used. The arrays keep their capacity when the
+     * object gets cleared, so reusing the same object for all rows
+     * avoids allocations.
+     */
     class PGParams 
     {
         private:
-            char ** _values;
-            int * _valueLengths;
-            int _length;
+            std::vector<const char *> _values;
+            std::vector<int> _valueLengths;
+            std::vector<int> _formats;
 
         public:
+            PGParams() {};
             PGParams(const std::vector<QueryValue> &qValues);
-            ~PGParams();
 
-            char ** values() 
+            /** disable copying */
+            PGParams(const PGParams &) = delete;
+            PGParams& operator=(const PGParams &) = delete;
+
+            /**
+             * remove all parameters
+             */
+            void clear();
+
+            void reserve(size_t n);
+
+            /**
+             * append a value using the text format
+             */
+            void add(const QueryValue &qValue);
+            void add(const std::vector<QueryValue> &qValues);
+
+            /**
+             * send the parameter at the index using the binary format.
+             *
+             * The data is not copied and has to stay valid as long as
+             * this object is used.
+             */
+            void setBinary(int index, const char * data, int dataLength);
+
+            const char * const * values() const
+            {
+                return _values.data();
+            };
+
+            const int * valueLenghts() const
             {
-                return _values;
+                return _valueLengths.data();
             };
 
-            int * valueLenghts() 
+            const int * formats() const
             {
-                return _valueLengths;
+                return _formats.data();
             };
 
-            int length()
+            int length() const
             {
-                return _length;
+                return static_cast<int>(_values.size());
             };
     };
 };
@@ -0,0 +1,381 @@
+#include <algorithm>
+#include <sstream>
+
+#include "server/featureinserter.h"
+#include "server/db/connection.h"
+#include "common/config.h"
+
+
+using namespace Batyr;
+
+
+static const char * insertSavepoint = "insertfeature";
+
+/** the max. number of parameters of a statement supported by the postgresql protocol */
+static const unsigned int maxStatementParams = 65535;
+
+
+FeatureInserter::FeatureInserter(Db::Transaction & _transaction, const std::string & _insertSqlPrefix,
+            RowExpressionBuilder _buildRowExpression, unsigned int _numColumns,
+            const std::string & _stmtBaseName, int _geometryValueIdx,
+            bool _ignoreFailures, unsigned int _batchSize)
+    :   logger(Poco::Logger::get("FeatureInserter")),
+        transaction(_transaction),
+        insertSqlPrefix(_insertSqlPrefix),
+        buildRowExpression(_buildRowExpression),
+        stmtBaseName(_stmtBaseName),
+        numColumns(_numColumns),
+        geometryValueIdx(_geometryValueIdx),
+        ignoreFailures(_ignoreFailures),
+        batchSize(std::max(_batchSize, 1u)),
+        pipelined(Db::Transaction::supportsPipelineMode()),
+        numIgnored(0),
+        numPendingFeatures(0)
+{
+    if ((numColumns > 0) && (batchSize * numColumns > maxStatementParams)) {
+        batchSize = maxStatementParams / numColumns;
+
+        std::stringstream msgStream;
+        msgStream << "Limiting the insert batch size to " << batchSize
+                  << " features to stay below the max. number of statement parameters";
+        poco_information(logger, msgStream.str().c_str());
+    }
+
+    maxPendingFeatures = batchSize;
+    if (pipelined) {
+        maxPendingFeatures *= SERVER_DB_PIPELINE_DEPTH;
+    }
+    pendingFeatures.reserve(maxPendingFeatures);
+    batchParams.reserve(batchSize * numColumns);
+
+    // the statement used for full batches is always needed
+    prepareStatements({batchSize});
+
+    if (pipelined) {
+        transaction.enterPipelineMode();
+    }
+}
+
+
+void
+FeatureInserter::insert(GIntBig fid, std::vector<QueryValue> & values, const unsigned char * wkb, size_t wkbSize)
+{
+    // keep the feature until its insert is confirmed. The feature might
+    // need to be send again when another feature of its batch fails.
+    // The slots are reused for all batches and the values are swapped,
+    // so the caller gets the storage of a previous feature back.
+    if (numPendingFeatures == pendingFeatures.size()) {
+        pendingFeatures.push_back(PendingFeature());
+    }
+    auto & pendingFeature = pendingFeatures[numPendingFeatures];
+    pendingFeature.fid = fid;
+    pendingFeature.values.swap(values);
+    pendingFeature.wkb.assign(reinterpret_cast<const char *>(wkb), wkbSize);
+    numPendingFeatures++;
+
+    if (numPendingFeatures >= maxPendingFeatures) {
+        flush();
+    }
+}
+
+
+void
+FeatureInserter::finish()
+{
+    flush();
+    if (pipelined) {
+        transaction.exitPipelineMode();
+        pipelined = false;
+    }
+}
+
+
+void
+FeatureInserter::prepareStatements(const std::vector<size_t> & rowCounts)
+{
+    std::vector<size_t> missingRowCounts;
+    for (size_t numRows : rowCounts) {
+        if ((statementNames.find(numRows) == statementNames.end()) &&
+                    (std::find(missingRowCounts.begin(), missingRowCounts.end(), numRows) == missingRowCounts.end())) {
+            missingRowCounts.push_back(numRows);
+        }
+    }
+    if (missingRowCounts.empty()) {
+        return;
+    }
+
+    // statements can not be prepared synchronously in pipeline mode. This
+    // is only called when no results are outstanding.
+    if (pipelined) {
+        transaction.exitPipelineMode();
+    }
+
+    for (size_t numRows : missingRowCounts) {
+        std::stringstream sqlStream;
+        sqlStream << insertSqlPrefix;
+        for (size_t row=0; row<numRows; row++) {
+            if (row > 0) {
+                sqlStream << ", ";
+            }
+            sqlStream << buildRowExpression(row * numColumns + 1);
+        }
+
+        std::string stmtName = stmtBaseName + "_" + std::to_string(numRows);
+        if (numRows == batchSize || numRows == 1) {
+            poco_debug(logger, sqlStream.str().c_str());
+        }
+        transaction.prepare(stmtName, sqlStream.str(), numRows * numColumns, NULL);
+        statementNames[numRows] = stmtName;
+    }
+
+    if (pipelined) {
+        transaction.enterPipelineMode();
+    }
+}
+
+
+void
+FeatureInserter::flush()
+{
+    for (size_t first=0; first<numPendingFeatures; first+=batchSize) {
+        batches.push_back({first, std::min(batchSize, numPendingFeatures - first)});
+    }
+
+    std::vector<size_t> rowCounts;
+    while (!batches.empty()) {
+        rowCounts.clear();
+        for (const auto & batch : batches) {
+            rowCounts.push_back(batch.count);
+        }
+        prepareStatements(rowCounts);
+
+        if (pipelined) {
+            execPipelinedBatches();
+        }
+        else {
+            execNextBatch();
+        }
+    }
+    numPendingFeatures = 0;
+}
+
+
+void
+FeatureInserter::buildBatchParams(const Batch & batch)
+{
+    batchParams.clear();
+    for (size_t i=batch.first; i<batch.first + batch.count; i++) {
+        batchParams.add(pendingFeatures[i].values);
+    }
+
+    if (geometryValueIdx >= 0) {
+        for (size_t row=0; row<batch.count; row++) {
+            const auto & wkb = pendingFeatures[batch.first + row].wkb;
+            if (!wkb.empty()) {
+                batchParams.setBinary(row * numColumns + geometryValueIdx, wkb.data(), wkb.size());
+            }
+        }
+    }
+}
+
+
+void
+FeatureInserter::execNextBatch()
+{
+    Batch batch = batches.front();
+    batches.pop_front();
+
+    if (ignoreFailures) {
+        std::string message;
+        if (!execSingleBatch(batch, message)) {
+            handleFailedBatch(batch, message);
+        }
+    }
+    else {
+        buildBatchParams(batch);
+        try {
+            transaction.execPrepared(statementNames[batch.count], batchParams);
+        }
+        catch (Db::DbError &e) {
+            throw batchError(batch, e);
+        }
+    }
+}
+
+
+bool
+FeatureInserter::execSingleBatch(const Batch & batch, std::string & message)
+{
+    prepareStatements({batch.count});
+
+    if (pipelined) {
+        // a pipeline of a single batch, so nothing gets skipped when it fails
+        sendBatch(batch);
+        transaction.pipelineSync();
+
+        Db::PGresultPtr failedResult(nullptr, PQclear);
+        if (collectPipelineResults(1, failedResult) < 0) {
+            return true;
+        }
+
+        auto error = transaction.errorFromResult(failedResult.get());
+        if (!error.isDataException()) {
+            throw batchError(batch, error);
+        }
+        rollbackPipelinedBatch();
+        message = error.what();
+        return false;
+    }
+
+    buildBatchParams(batch);
+    try {
+        transaction.savepoint(insertSavepoint);
+        transaction.execPrepared(statementNames[batch.count], batchParams);
+        transaction.releaseSavepoint(insertSavepoint);
+    }
+    catch (Db::DbError &e) {
+        if (!e.isDataException()) {
+            throw batchError(batch, e);
+        }
+        transaction.rollbackToSavepoint(insertSavepoint);
+        message = e.what();
+        return false;
+    }
+    return true;
+}
+
+
+void
+FeatureInserter::sendBatch(const Batch & batch)
+{
+    buildBatchParams(batch);
+
+    if (ignoreFailures) {
+        transaction.sendQuery(std::string("savepoint ") + insertSavepoint);
+    }
+    transaction.sendPrepared(statementNames[batch.count], batchParams);
+    if (ignoreFailures) {
+        transaction.sendQuery(std::string("release savepoint ") + insertSavepoint);
+    }
+}
+
+
+void
+FeatureInserter::execPipelinedBatches()
+{
+    for (const auto & batch : batches) {
+        sendBatch(batch);
+    }
+    transaction.pipelineSync();
+
+    Db::PGresultPtr failedResult(nullptr, PQclear);
+    int failedIdx = collectPipelineResults(batches.size(), failedResult);
+    if (failedIdx < 0) {
+        batches.clear();
+        return;
+    }
+
+    // all batches before the failed one have been written. The batches
+    // after it have been skipped by the server and stay queued to be sent
+    // once the failed batch has been dealt with.
+    Batch failedBatch = batches[failedIdx];
+    batches.erase(batches.begin(), batches.begin() + failedIdx + 1);
+
+    auto error = transaction.errorFromResult(failedResult.get());
+    if (!ignoreFailures || !error.isDataException()) {
+        throw batchError(failedBatch, error);
+    }
+
+    rollbackPipelinedBatch();
+    handleFailedBatch(failedBatch, error.what());
+}
+
+
+void
+FeatureInserter::rollbackPipelinedBatch()
+{
+    // the savepoint of the failed batch is still active
+    transaction.sendQuery(std::string("rollback to savepoint ") + insertSavepoint);
+    transaction.pipelineSync();
+    auto rollbackRes = transaction.getPipelineResult();
+    if (PQresultStatus(rollbackRes.get()) == PGRES_FATAL_ERROR) {
+        throw transaction.errorFromResult(rollbackRes.get());
+    }
+    transaction.consumePipelineSync();
+}
+
+
+int
+FeatureInserter::collectPipelineResults(size_t numBatches, Db::PGresultPtr & failedResult)
+{
+    int failedIdx = -1;
+
+    // savepoint, insert and release per batch when failures are ignored
+    const int queriesPerBatch = ignoreFailures ? 3 : 1;
+
+    for (size_t i=0; i<numBatches; i++) {
+        for (int q=0; q<queriesPerBatch; q++) {
+            auto res = transaction.getPipelineResult();
+
+            // all queries after the failed one are reported as aborted
+            if ((failedIdx < 0) && (PQresultStatus(res.get()) == PGRES_FATAL_ERROR)) {
+                failedIdx = static_cast<int>(i);
+                failedResult = std::move(res);
+            }
+        }
+    }
+    transaction.consumePipelineSync();
+    return failedIdx;
+}
+
+
+void
+FeatureInserter::handleFailedBatch(const Batch & batch, const std::string & message)
+{
+    if (batch.count == 1) {
+        numIgnored++;
+
+        std::stringstream ignoreMsgStream;
+        ignoreMsgStream << "Ignoring feature with fid " << pendingFeatures[batch.first].fid << ": " << message;
+        poco_warning(logger, ignoreMsgStream.str().c_str());
+        return;
+    }
+
+    // bisect the batch to isolate the failing features. The halves are
+    // executed one by one before the remaining batches to keep the order of
+    // the features. The queued batches are not sent along with them, so
+    // they are only sent once after the failing features have been found.
+    size_t firstHalf = batch.count / 2;
+    const Batch halves[] = {
+        {batch.first, firstHalf},
+        {batch.first + firstHalf, batch.count - firstHalf}
+    };
+    for (const auto & half : halves) {
+        std::string halfMessage;
+        if (!execSingleBatch(half, halfMessage)) {
+            handleFailedBatch(half, halfMessage);
+        }
+    }
+}
+
+
+Db::DbError
+FeatureInserter::batchError(const Batch & batch, Db::DbError & error)
+{
+    std::stringstream msgStream;
+    msgStream << error.what();
+    if (batch.count == 1) {
+        msgStream << " (feature with fid " << pendingFeatures[batch.first].fid << ")";
+    }
+    else {
+        msgStream << " (in a batch of " << batch.count << " features with fids "
+                  << pendingFeatures[batch.first].fid << " to "
+                  << pendingFeatures[batch.first + batch.count - 1].fid << ")";
+    }
+
+    Db::DbError featureError(msgStream.str(), error.getSqlState());
+    if (error.hasContext()) {
+        featureError.setContext(error.getContext());
+    }
+    return featureError;
+}
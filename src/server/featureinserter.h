@@ -0,0 +1,197 @@
+#ifndef __batyr_featureinserter_h__
+#define __batyr_featureinserter_h__
+
+#include <Poco/Logger.h>
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "server/db/transaction.h"
+#include "server/db/queryvalue.h"
+
+#include "ogrsf_frmts.h"
+
+
+namespace Batyr
+{
+
+    /**
+     * writes converted features to the staging table using prepared
+     * insert statements.
+     *
+     * Features are collected and inserted in batches of insert_batch_size
+     * rows per statement. When libpq supports the pipeline mode, the
+     * statements are send without waiting for the result of each single
+     * statement. When failures are ignored, each batch is inserted within
+     * a savepoint and failing batches are bisected until the failing
+     * features are isolated, so they are still reported individually.
+     */
+    class FeatureInserter
+    {
+        public:
+            /**
+             * build the VALUES expression of a single row. The parameters
+             * of the row start with the placeholder $firstParam.
+             */
+            typedef std::function<std::string (unsigned int firstParam)> RowExpressionBuilder;
+
+        private:
+            Poco::Logger & logger;
+            Db::Transaction & transaction;
+
+            /** "insert into ... values " -- the rows get appended */
+            std::string insertSqlPrefix;
+            RowExpressionBuilder buildRowExpression;
+            std::string stmtBaseName;
+            unsigned int numColumns;
+
+            /** position of the geometry in the values of a feature. -1 for none */
+            int geometryValueIdx;
+
+            /** skip features which can not be inserted because of a DataException */
+            bool ignoreFailures;
+
+            /** max. number of features per insert statement */
+            size_t batchSize;
+
+            bool pipelined;
+            int numIgnored;
+
+            struct PendingFeature
+            {
+                GIntBig fid;
+                std::vector<QueryValue> values;
+                std::string wkb;
+            };
+
+            /**
+             * features which have not been written yet. Only the first
+             * numPendingFeatures entries are used, the others are kept to
+             * reuse their storage.
+             */
+            std::vector<PendingFeature> pendingFeatures;
+            size_t numPendingFeatures;
+            size_t maxPendingFeatures;
+
+            /** a range of pending features inserted using a single statement */
+            struct Batch
+            {
+                size_t first;
+                size_t count;
+            };
+
+            /** batches waiting to be executed */
+            std::deque<Batch> batches;
+
+            /** names of the prepared statements by the number of rows they insert */
+            std::map<size_t, std::string> statementNames;
+
+            /**
+             * prepare the statements inserting the given numbers of rows
+             * which have not been prepared yet
+             */
+            void prepareStatements(const std::vector<size_t> & rowCounts);
+
+            /**
+             * write all pending features
+             */
+            void flush();
+
+            /**
+             * execute the first queued batch and wait for its result
+             */
+            void execNextBatch();
+
+            /**
+             * execute a single batch within a savepoint and wait for its
+             * result. Used when failures are ignored.
+             *
+             * returns false when the batch failed because of a DataException.
+             * The transaction has been rolled back to the savepoint then and
+             * the message of the error is set.
+             */
+            bool execSingleBatch(const Batch & batch, std::string & message);
+
+            /**
+             * send all queued batches in pipeline mode and collect their
+             * results. Stops at the first failing batch.
+             */
+            void execPipelinedBatches();
+
+            void sendBatch(const Batch & batch);
+
+            /**
+             * collect the results of the first numBatches sent batches up to
+             * the next synchronization point.
+             *
+             * returns the index of the first batch which failed and its
+             * result or -1 if all succeeded
+             */
+            int collectPipelineResults(size_t numBatches, Db::PGresultPtr & failedResult);
+
+            /**
+             * roll back to the savepoint of a batch which failed in
+             * pipeline mode
+             */
+            void rollbackPipelinedBatch();
+
+            /**
+             * parameters of the current batch. Reused for all batches
+             */
+            Db::PGParams batchParams;
+
+            void buildBatchParams(const Batch & batch);
+
+            /**
+             * a batch failed because of a DataException which should be
+             * ignored. The transaction has already been rolled back to the
+             * savepoint of the batch.
+             *
+             * Single features get skipped, larger batches are split in
+             * halves which are retried one at a time until the failing
+             * features are isolated.
+             */
+            void handleFailedBatch(const Batch & batch, const std::string & message);
+
+            /**
+             * add the fids of the features of the batch to the error
+             */
+            Db::DbError batchError(const Batch & batch, Db::DbError & error);
+
+        public:
+            FeatureInserter(Db::Transaction & _transaction, const std::string & _insertSqlPrefix,
+                        RowExpressionBuilder _buildRowExpression, unsigned int _numColumns,
+                        const std::string & _stmtBaseName, int _geometryValueIdx,
+                        bool _ignoreFailures, unsigned int _batchSize);
+
+            /** disable copying */
+            FeatureInserter(const FeatureInserter &) = delete;
+            FeatureInserter& operator=(const FeatureInserter &) = delete;
+
+            /**
+             * insert a feature. The values must be in the order of
+             * the placeholders of a row. The slot of the geometry is
+             * ignored, the geometry is given as WKB instead.
+             *
+             * The values are taken over by swapping them with the values
+             * of a previously written feature.
+             */
+            void insert(GIntBig fid, std::vector<QueryValue> & values, const unsigned char * wkb, size_t wkbSize);
+
+            /**
+             * wait until all features have been written
+             */
+            void finish();
+
+            int getNumIgnored() const
+            {
+                return numIgnored;
+            }
+    };
+
+};
+
+#endif // __batyr_featureinserter_h__
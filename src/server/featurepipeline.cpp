@@ -0,0 +1,233 @@
+#include <memory>
+
+#include "server/featurepipeline.h"
+#include "common/config.h"
+
+
+using namespace Batyr;
+
+
+static void
+destroyFeatures(std::vector<OGRFeature *> & chunk)
+{
+    for (auto & ogrFeature : chunk) {
+        if (ogrFeature != nullptr) {
+            OGRFeature::DestroyFeature(ogrFeature);
+            ogrFeature = nullptr;
+        }
+    }
+    chunk.clear();
+}
+
+
+FeaturePipeline::FeaturePipeline(OGRLayer * _ogrLayer, const ColumnPlan & _columnPlan,
+            unsigned int _numConvertThreads)
+    :   logger(Poco::Logger::get("FeaturePipeline")),
+        ogrLayer(_ogrLayer),
+        columnPlan(_columnPlan),
+        numConvertThreads(_numConvertThreads),
+        featureQueue(2 * _numConvertThreads),
+        convertedQueue(2 * _numConvertThreads),
+        numActiveConverters(_numConvertThreads),
+        currentIdx(0)
+{
+    if (numConvertThreads > 0) {
+        poco_debug(logger, "Starting the pipeline with " + std::to_string(numConvertThreads) + " converter threads");
+        try {
+            threads.emplace_back(&FeaturePipeline::read, this);
+            for (unsigned int i=0; i<numConvertThreads; i++) {
+                threads.emplace_back(&FeaturePipeline::convert, this);
+            }
+        }
+        catch (...) {
+            stop();
+            throw;
+        }
+    }
+}
+
+
+FeaturePipeline::~FeaturePipeline()
+{
+    stop();
+}
+
+
+void
+FeaturePipeline::stop()
+{
+    featureQueue.abort();
+    convertedQueue.abort();
+    for (auto & thread : threads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+    threads.clear();
+
+    FeatureChunk chunk;
+    while (featureQueue.drain(chunk)) {
+        destroyFeatures(chunk);
+    }
+}
+
+
+void
+FeaturePipeline::fail(std::exception_ptr e)
+{
+    {
+        std::unique_lock<std::mutex> lock(errorMutex);
+        if (!error) {
+            error = e;
+        }
+    }
+    featureQueue.abort();
+    convertedQueue.abort();
+}
+
+
+void
+FeaturePipeline::read()
+{
+    FeatureChunk chunk;
+    try {
+        chunk.reserve(SERVER_FEATURE_CHUNK_SIZE);
+
+        OGRFeature * ogrFeature = nullptr;
+        while ((ogrFeature = ogrLayer->GetNextFeature()) != nullptr) {
+            chunk.push_back(ogrFeature);
+            if (chunk.size() >= SERVER_FEATURE_CHUNK_SIZE) {
+                if (!featureQueue.push(std::move(chunk))) {
+                    // the pipeline has been stopped
+                    break;
+                }
+                chunk.clear();
+                chunk.reserve(SERVER_FEATURE_CHUNK_SIZE);
+            }
+        }
+        if (!chunk.empty()) {
+            featureQueue.push(std::move(chunk));
+        }
+        featureQueue.close();
+    }
+    catch (...) {
+        fail(std::current_exception());
+    }
+
+    // features which could not be passed on
+    destroyFeatures(chunk);
+}
+
+
+void
+FeaturePipeline::recycleChunk(ConvertedChunk & chunk)
+{
+    std::unique_lock<std::mutex> lock(recycledMutex);
+    recycledChunks.push_back(std::move(chunk));
+    chunk.clear();
+}
+
+
+void
+FeaturePipeline::reuseChunk(ConvertedChunk & chunk)
+{
+    std::unique_lock<std::mutex> lock(recycledMutex);
+    if (!recycledChunks.empty()) {
+        chunk.swap(recycledChunks.back());
+        recycledChunks.pop_back();
+    }
+}
+
+
+void
+FeaturePipeline::convert()
+{
+    FeatureChunk chunk;
+
+    // the chunk of this converter. Its storage is passed on with the
+    // converted features and replaced by a recycled chunk afterwards.
+    ConvertedChunk converted;
+    try {
+        while (featureQueue.pop(chunk)) {
+            if (converted.empty()) {
+                reuseChunk(converted);
+            }
+
+            // resizing keeps the storage of the existing features
+            converted.resize(chunk.size());
+            for (size_t i=0; i<chunk.size(); i++) {
+                convertFeature(chunk[i], columnPlan, converted[i]);
+                OGRFeature::DestroyFeature(chunk[i]);
+                chunk[i] = nullptr;
+            }
+            chunk.clear();
+
+            if (!convertedQueue.push(std::move(converted))) {
+                // the pipeline has been stopped
+                break;
+            }
+            converted.clear();
+        }
+    }
+    catch (...) {
+        fail(std::current_exception());
+    }
+    destroyFeatures(chunk);
+
+    // the last converter signals that no more features will follow
+    if (--numActiveConverters == 0) {
+        convertedQueue.close();
+    }
+}
+
+
+bool
+FeaturePipeline::next(ConvertedFeature & feature)
+{
+    if (numConvertThreads == 0) {
+        // ensure that features get free'd by wraping them in a smart pointer
+        std::unique_ptr<OGRFeature, decltype((OGRFeature::DestroyFeature))> ogrFeature(
+                ogrLayer->GetNextFeature(), OGRFeature::DestroyFeature);
+        if (!ogrFeature) {
+            return false;
+        }
+        convertFeature(ogrFeature.get(), columnPlan, feature);
+        return true;
+    }
+
+    while (currentIdx >= currentChunk.size()) {
+        if (!currentChunk.empty()) {
+            recycleChunk(currentChunk);
+        }
+        currentIdx = 0;
+        if (!convertedQueue.pop(currentChunk)) {
+            std::unique_lock<std::mutex> lock(errorMutex);
+            if (error) {
+                std::rethrow_exception(error);
+            }
+            return false;
+        }
+    }
+
+    auto & converted = currentChunk[currentIdx++];
+    feature.fid = converted.fid;
+    feature.values.swap(converted.values);
+    feature.wkb.swap(converted.wkb);
+    feature.wkbSize = converted.wkbSize;
+    return true;
+}
+
+
+void
+FeaturePipeline::convertFeature(OGRFeature * ogrFeature, const ColumnPlan & columnPlan,
+            ConvertedFeature & feature)
+{
+    feature.fid = ogrFeature->GetFID();
+    columnPlan.convertFeature(ogrFeature, feature.values);
+
+    feature.wkbSize = 0;
+    if (columnPlan.getGeometryIdx() >= 0) {
+        feature.wkbSize = ColumnPlan::exportGeometryToWkb(ogrFeature, feature.wkb);
+    }
+    columnPlan.computeDigest(feature.values, feature.wkb.data(), feature.wkbSize);
+}
@@ -0,0 +1,140 @@
+#ifndef __batyr_featurepipeline_h__
+#define __batyr_featurepipeline_h__
+
+#include <Poco/Logger.h>
+
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "server/boundedqueue.h"
+#include "server/columnplan.h"
+#include "server/db/queryvalue.h"
+
+#include "ogrsf_frmts.h"
+
+
+namespace Batyr
+{
+
+    /**
+     * a feature converted to the values of the columns of a ColumnPlan
+     */
+    struct ConvertedFeature
+    {
+        GIntBig fid;
+        std::vector<QueryValue> values;
+
+        /** WKB of the geometry. Only the first wkbSize bytes are valid */
+        std::vector<unsigned char> wkb;
+        size_t wkbSize;
+
+        ConvertedFeature()
+            :   fid(0),
+                wkbSize(0)
+        {};
+    };
+
+
+    /**
+     * reads the features of an OGRLayer and converts them according
+     * to a ColumnPlan.
+     *
+     * With numConvertThreads > 0 this happens in a pipeline of
+     * threads: one thread reads the features from the layer, the
+     * converter threads convert them and the thread calling next
+     * receives the converted features to write them to the database.
+     * The stages are connected by bounded queues, so a slow stage
+     * slows down the others instead of buffering the whole layer.
+     *
+     * The layer is only accessed by the reader thread while the
+     * pipeline is running. The order of the converted features is not
+     * preserved.
+     *
+     * Without converter threads, the features are read and converted
+     * by the thread calling next.
+     */
+    class FeaturePipeline
+    {
+        private:
+            typedef std::vector<OGRFeature *> FeatureChunk;
+            typedef std::vector<ConvertedFeature> ConvertedChunk;
+
+            Poco::Logger & logger;
+            OGRLayer * ogrLayer;
+            const ColumnPlan & columnPlan;
+            unsigned int numConvertThreads;
+
+            BoundedQueue<FeatureChunk> featureQueue;
+            BoundedQueue<ConvertedChunk> convertedQueue;
+
+            std::vector<std::thread> threads;
+
+            /** number of converter threads which did not finish yet */
+            std::atomic<unsigned int> numActiveConverters;
+
+            /** the first error which occured in one of the threads */
+            std::mutex errorMutex;
+            std::exception_ptr error;
+
+            /** the chunk currently consumed by next */
+            ConvertedChunk currentChunk;
+            size_t currentIdx;
+
+            /**
+             * chunks which have been consumed by next and are handed back
+             * to the converter threads. The converted features keep the
+             * storage of their values and WKB, so once the pipeline is
+             * running the converters do not allocate new chunks.
+             */
+            std::mutex recycledMutex;
+            std::vector<ConvertedChunk> recycledChunks;
+
+            void read();
+            void convert();
+            void fail(std::exception_ptr e);
+
+            void recycleChunk(ConvertedChunk & chunk);
+
+            /**
+             * replace the empty chunk with a recycled one - if there is any
+             */
+            void reuseChunk(ConvertedChunk & chunk);
+
+            /**
+             * stop all threads and free all features still queued
+             */
+            void stop();
+
+        public:
+            FeaturePipeline(OGRLayer * _ogrLayer, const ColumnPlan & _columnPlan,
+                        unsigned int _numConvertThreads);
+            ~FeaturePipeline();
+
+            /** disable copying */
+            FeaturePipeline(const FeaturePipeline &) = delete;
+            FeaturePipeline& operator=(const FeaturePipeline &) = delete;
+
+            /**
+             * fetch the next converted feature. The contents of the feature
+             * are swapped, so its storage gets reused.
+             *
+             * returns false when all features of the layer have been
+             * fetched. Errors of the reader and converter threads are
+             * rethrown here.
+             */
+            bool next(ConvertedFeature & feature);
+
+            /**
+             * convert a feature and export its geometry as WKB
+             */
+            static void convertFeature(OGRFeature * ogrFeature, const ColumnPlan & columnPlan,
+                        ConvertedFeature & feature);
+    };
+
+};
+
+#endif // __batyr_featurepipeline_h__
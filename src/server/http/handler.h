@@ -9,6 +9,9 @@
 
 #include "server/jobstorage.h"
 #include "server/configuration.h"
+#include "server/db/connectionpool.h"
+#include "server/db/metadatacache.h"
+#include "server/db/asyncexecutor.h"
 
 
 namespace Batyr 
@@ -21,6 +24,9 @@ namespace Http
         protected:
             Configuration::Ptr configuration;
             std::weak_ptr<JobStorage> jobs;
+            std::weak_ptr<Db::ConnectionPool> dbPool;
+            std::weak_ptr<Db::MetadataCache> metadataCache;
+            std::weak_ptr<Db::AsyncExecutor> asyncExecutor;
 
             void prepareResponse(Poco::Net::HTTPServerResponse &resp);
             void prepareApiResponse(Poco::Net::HTTPServerResponse &resp);
@@ -32,6 +38,21 @@ namespace Http
             {
                 jobs = _jobs;
             }
+
+            void setDbPool(std::weak_ptr<Db::ConnectionPool> _dbPool)
+            {
+                dbPool = _dbPool;
+            }
+
+            void setMetadataCache(std::weak_ptr<Db::MetadataCache> _metadataCache)
+            {
+                metadataCache = _metadataCache;
+            }
+
+            void setAsyncExecutor(std::weak_ptr<Db::AsyncExecutor> _asyncExecutor)
+            {
+                asyncExecutor = _asyncExecutor;
+            }
             
     };
 
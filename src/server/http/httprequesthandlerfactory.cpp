@@ -6,6 +6,7 @@
 #include "server/http/pullhandler.h"
 #include "server/http/removebyattributeshandler.h"
 #include "server/http/statushandler.h"
+#include "server/http/invalidatemetadatacachehandler.h"
 #include "server/http/notfoundhandler.h"
 #include "server/http/joblisthandler.h"
 #include "server/http/getjobhandler.h"
@@ -84,8 +85,16 @@ HTTPRequestHandlerFactory::createRequestHandler(const Poco::Net::HTTPServerReque
     else if (endpoint == "api/v1/status.json") {
         auto statusHandler = new StatusHandler(configuration);
         statusHandler->setJobs(jobs);
+        statusHandler->setDbPool(dbPool);
+        statusHandler->setMetadataCache(metadataCache);
+        statusHandler->setAsyncExecutor(asyncExecutor);
         return statusHandler;
     }
+    else if (endpoint == "api/v1/invalidate-metadata-cache") {
+        auto invalidateHandler = new InvalidateMetadataCacheHandler(configuration);
+        invalidateHandler->setMetadataCache(metadataCache);
+        return invalidateHandler;
+    }
 
     std::string getJobPath = "api/v1/job/";
     if (endpoint.compare(0, getJobPath.length(), getJobPath) == 0) {
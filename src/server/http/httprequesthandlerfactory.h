@@ -11,6 +11,9 @@
 
 #include "server/jobstorage.h"
 #include "server/configuration.h"
+#include "server/db/connectionpool.h"
+#include "server/db/metadatacache.h"
+#include "server/db/asyncexecutor.h"
 
 namespace Batyr
 {
@@ -27,11 +30,29 @@ namespace Http
             {
                 jobs = _jobs;
             }
-            
+
+            void setDbPool(std::weak_ptr<Db::ConnectionPool> _dbPool)
+            {
+                dbPool = _dbPool;
+            }
+
+            void setMetadataCache(std::weak_ptr<Db::MetadataCache> _metadataCache)
+            {
+                metadataCache = _metadataCache;
+            }
+
+            void setAsyncExecutor(std::weak_ptr<Db::AsyncExecutor> _asyncExecutor)
+            {
+                asyncExecutor = _asyncExecutor;
+            }
+
         private:
             Poco::Logger & logger;
             Configuration::Ptr configuration;
             std::weak_ptr<JobStorage> jobs;
+            std::weak_ptr<Db::ConnectionPool> dbPool;
+            std::weak_ptr<Db::MetadataCache> metadataCache;
+            std::weak_ptr<Db::AsyncExecutor> asyncExecutor;
 
             std::string normalizeUri(const std::string) const;
     };
@@ -0,0 +1,134 @@
+#include "server/http/invalidatemetadatacachehandler.h"
+#include "server/json.h"
+#include "server/error.h"
+#include "common/stringutils.h"
+
+#include <Poco/Net/HTTPResponse.h>
+#include <iostream>
+#include <stdexcept>
+#include <sstream>
+
+using namespace Batyr::Http;
+
+
+InvalidateMetadataCacheHandler::InvalidateMetadataCacheHandler(Configuration::Ptr _configuration)
+    :   Handler(_configuration),
+        logger(Poco::Logger::get("Http::InvalidateMetadataCacheHandler"))
+{
+}
+
+
+void
+InvalidateMetadataCacheHandler::handleRequest(Poco::Net::HTTPServerRequest &req, Poco::Net::HTTPServerResponse &resp)
+{
+    prepareApiResponse(resp);
+
+    if (req.getMethod() != "POST") {
+        resp.setStatus(Poco::Net::HTTPResponse::HTTP_BAD_REQUEST);
+        resp.setReason("Bad Request");
+
+        Error error("Only POST requests are supported");
+
+        std::ostream & out = resp.send();
+        out << error;
+        out.flush();
+        return;
+    }
+
+    // an empty body invalidates the metadata of all tables
+    std::string layerName;
+    try {
+        // read the whole request body into memory
+        std::stringstream bodystream;
+        bodystream << req.stream().rdbuf();
+        std::string body = StringUtils::trim(bodystream.str());
+
+        if (!body.empty()) {
+            rapidjson::Document doc;
+            doc.Parse<0>(body.c_str());
+
+            if (doc.HasParseError()) {
+                throw std::invalid_argument("Invalid JSON data");
+            }
+            if (!doc.IsObject()) {
+                throw std::invalid_argument("JSON data should be an object");
+            }
+            if (doc.HasMember("layerName")) {
+                if (!doc["layerName"].IsString()) {
+                    throw std::invalid_argument("Key layerName should be a string");
+                }
+                layerName = doc["layerName"].GetString();
+            }
+        }
+    }
+    catch (std::exception &e) {
+        resp.setStatus(Poco::Net::HTTPResponse::HTTP_BAD_REQUEST);
+        resp.setReason("Bad Request");
+
+        Error error(e.what());
+        poco_warning(logger, e.what());
+
+        std::ostream & out = resp.send();
+        out << error;
+        out.flush();
+        return;
+    }
+
+    // return 404 if layer does not exist
+    Layer::Ptr layer;
+    if (!layerName.empty()) {
+        try {
+            layer = configuration->getLayer(layerName);
+        }
+        catch (ConfigurationError) {
+            // layer does not exist
+            resp.setStatus(Poco::Net::HTTPResponse::HTTP_NOT_FOUND);
+            resp.setReason("Not Found");
+
+            std::stringstream msgstream;
+            msgstream << "Layer \"" << layerName << "\" does not exist";
+
+            Error error(msgstream.str());
+            poco_warning(logger, error.getMessage());
+
+            std::ostream & out = resp.send();
+            out << error;
+            out.flush();
+            return;
+        }
+    }
+
+    size_t numRemoved = 0;
+    if (auto cache = metadataCache.lock()) {
+        if (layer) {
+            poco_information(logger, "Invalidating the cached metadata of layer \"" + layerName + "\"");
+            numRemoved = cache->invalidateTable(layer->target_table_schema, layer->target_table_name);
+        }
+        else {
+            poco_information(logger, "Invalidating the cached metadata of all layers");
+            numRemoved = cache->invalidateAll();
+        }
+    }
+    else {
+        resp.setStatus(Poco::Net::HTTPResponse::HTTP_INTERNAL_SERVER_ERROR);
+        resp.setReason("Internal Server Error");
+
+        const char * emsg = "Could not get a lock on the metadata cache";
+        Error error(emsg);
+        poco_error(logger, emsg);
+
+        std::ostream & out = resp.send();
+        out << error;
+        out.flush();
+        return;
+    }
+
+    rapidjson::Document doc;
+    doc.SetObject();
+    doc.AddMember("numRemovedEntries", static_cast<uint64_t>(numRemoved), doc.GetAllocator());
+
+    resp.setStatus(Poco::Net::HTTPResponse::HTTP_OK);
+    std::ostream & out = resp.send();
+    out << Batyr::Json::stringify(doc);
+    out.flush();
+};
@@ -0,0 +1,30 @@
+#ifndef __batyr_http_invalidatemetadatacachehandler_h__
+#define __batyr_http_invalidatemetadatacachehandler_h__
+
+
+#include "Poco/Logger.h"
+
+#include <memory>
+
+#include "server/http/handler.h"
+
+namespace Batyr 
+{
+namespace Http
+{
+
+    class InvalidateMetadataCacheHandler : public Handler
+    {
+        private:
+            Poco::Logger & logger;
+
+        public:
+            InvalidateMetadataCacheHandler(Configuration::Ptr);
+            virtual void handleRequest(Poco::Net::HTTPServerRequest &req, Poco::Net::HTTPServerResponse &resp);
+
+    };
+
+};
+};
+
+#endif // __batyr_http_invalidatemetadatacachehandler_h__
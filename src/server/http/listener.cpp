@@ -51,6 +51,9 @@ Listener::run()
 
         // set the joblist
         handlerFactoryPtr->setJobs(jobs);
+        handlerFactoryPtr->setDbPool(dbPool);
+        handlerFactoryPtr->setMetadataCache(metadataCache);
+        handlerFactoryPtr->setAsyncExecutor(asyncExecutor);
 
         server->start();
         isRunning = true;
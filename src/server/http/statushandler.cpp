@@ -53,6 +53,55 @@ StatusHandler::handleRequest(Poco::Net::HTTPServerRequest &req, Poco::Net::HTTPS
     doc.AddMember("numWorkers", configuration->getNumWorkerThreads(),
                 doc.GetAllocator());
 
+    if (auto pool = dbPool.lock()) {
+        auto poolStats = pool->getStats();
+
+        rapidjson::Value vDbPool;
+        vDbPool.SetObject();
+        vDbPool.AddMember("numConnections", static_cast<uint64_t>(poolStats.numConnections), doc.GetAllocator());
+        vDbPool.AddMember("numIdle", static_cast<uint64_t>(poolStats.numIdle), doc.GetAllocator());
+        vDbPool.AddMember("numBorrowed", static_cast<uint64_t>(poolStats.numBorrowed), doc.GetAllocator());
+        vDbPool.AddMember("numWaiting", static_cast<uint64_t>(poolStats.numWaiting), doc.GetAllocator());
+        vDbPool.AddMember("maxConnections", static_cast<uint64_t>(poolStats.maxConnections), doc.GetAllocator());
+        vDbPool.AddMember("numOpened", poolStats.numOpened, doc.GetAllocator());
+        vDbPool.AddMember("numClosed", poolStats.numClosed, doc.GetAllocator());
+        vDbPool.AddMember("numWaitTimeouts", poolStats.numWaitTimeouts, doc.GetAllocator());
+        vDbPool.AddMember("numHealthChecksSkipped", poolStats.numHealthChecksSkipped, doc.GetAllocator());
+        vDbPool.AddMember("numHealthChecksSocket", poolStats.numHealthChecksSocket, doc.GetAllocator());
+        vDbPool.AddMember("numHealthChecksQuery", poolStats.numHealthChecksQuery, doc.GetAllocator());
+        vDbPool.AddMember("numConnectAttempts", poolStats.numConnectAttempts, doc.GetAllocator());
+        vDbPool.AddMember("numConnectFailures", poolStats.numConnectFailures, doc.GetAllocator());
+        vDbPool.AddMember("numConsecutiveConnectFailures", poolStats.numConsecutiveConnectFailures, doc.GetAllocator());
+        vDbPool.AddMember("backoffMs", static_cast<int64_t>(poolStats.backoffMs), doc.GetAllocator());
+        vDbPool.AddMember("backoffRemainingMs", static_cast<int64_t>(poolStats.backoffRemainingMs), doc.GetAllocator());
+        doc.AddMember("dbPool", vDbPool, doc.GetAllocator());
+    }
+
+    if (auto cache = metadataCache.lock()) {
+        auto cacheStats = cache->getStats();
+
+        rapidjson::Value vMetadataCache;
+        vMetadataCache.SetObject();
+        vMetadataCache.AddMember("numHits", cacheStats.numHits, doc.GetAllocator());
+        vMetadataCache.AddMember("numMisses", cacheStats.numMisses, doc.GetAllocator());
+        vMetadataCache.AddMember("numInvalidations", cacheStats.numInvalidations, doc.GetAllocator());
+        vMetadataCache.AddMember("numEntries", static_cast<uint64_t>(cacheStats.numEntries), doc.GetAllocator());
+        vMetadataCache.AddMember("ttl", configuration->getMetadataCacheTtl(), doc.GetAllocator());
+        doc.AddMember("metadataCache", vMetadataCache, doc.GetAllocator());
+    }
+
+    if (auto executor = asyncExecutor.lock()) {
+        auto executorStats = executor->getStats();
+
+        rapidjson::Value vAsyncExecutor;
+        vAsyncExecutor.SetObject();
+        vAsyncExecutor.AddMember("numInFlight", static_cast<uint64_t>(executorStats.numInFlight), doc.GetAllocator());
+        vAsyncExecutor.AddMember("numSubmitted", executorStats.numSubmitted, doc.GetAllocator());
+        vAsyncExecutor.AddMember("numCompleted", executorStats.numCompleted, doc.GetAllocator());
+        vAsyncExecutor.AddMember("numFailed", executorStats.numFailed, doc.GetAllocator());
+        doc.AddMember("asyncExecutor", vAsyncExecutor, doc.GetAllocator());
+    }
+
     std::ostream & out = resp.send();
     out << Batyr::Json::stringify(doc);
     out.flush();
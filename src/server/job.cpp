@@ -16,13 +16,16 @@ using namespace Batyr;
 
 Job::Job(Job::Type _type)
     :   type(_type),
+        force(false),
+        skipped(false),
         status(QUEUED),
         timeAdded(std::chrono::system_clock::now()),
         numCreated(0),
         numUpdated(0),
         numDeleted(0),
         numPulled(0),
-        numIgnored(0)
+        numIgnored(0),
+        numBytesKept(-1)
 {
     // generate an UUID as id for the job
     Poco::UUIDGenerator & uuidGen = Poco::UUIDGenerator::defaultGenerator();
@@ -39,6 +42,8 @@ Job::Job(Job::Type _type)
 void
 Job::toJsonValue(rapidjson::Value & targetValue, rapidjson::Document::AllocatorType & allocator) const
 {
+    std::lock_guard<std::mutex> lock(mutex);
+
     targetValue.SetObject();
     targetValue.AddMember("id", id.c_str(), allocator);
 
@@ -46,7 +51,7 @@ Job::toJsonValue(rapidjson::Value & targetValue, rapidjson::Document::AllocatorT
     Batyr::Json::toValue(vTimeAdded, timeAdded, allocator);
     targetValue.AddMember("timeAdded", vTimeAdded, allocator);
 
-    if (isDone()) {
+    if (isDoneUnlocked()) {
         rapidjson::Value vTimeFinished;
         Batyr::Json::toValue(vTimeFinished, timeFinished, allocator);
         targetValue.AddMember("timeFinished", vTimeFinished, allocator);
@@ -92,6 +97,7 @@ Job::toJsonValue(rapidjson::Value & targetValue, rapidjson::Document::AllocatorT
         rapidjson::Value vFilter;
         Batyr::Json::toValue(vFilter, filter, allocator);
         targetValue.AddMember("filter", vFilter, allocator);
+        targetValue.AddMember("force", force, allocator);
     }
     else if (type == REMOVE_BY_ATTRIBUTES) {
         rapidjson::Value vAttributeSets;
@@ -128,6 +134,18 @@ Job::toJsonValue(rapidjson::Value & targetValue, rapidjson::Document::AllocatorT
         targetValue.AddMember("numDeleted", numDeleted, allocator);
         targetValue.AddMember("numPulled", numPulled, allocator);
         targetValue.AddMember("numIgnored", numIgnored, allocator);
+        targetValue.AddMember("skipped", skipped, allocator);
+        if (numBytesKept >= 0) {
+            targetValue.AddMember("numBytesKept", static_cast<int64_t>(numBytesKept), allocator);
+        }
+
+        rapidjson::Value vStepTimings;
+        vStepTimings.SetObject();
+        for(const auto & stepTiming : stepTimings) {
+            rapidjson::Value vMilliseconds(stepTiming.second);
+            vStepTimings.AddMember(stepTiming.first.c_str(), allocator, vMilliseconds, allocator);
+        }
+        targetValue.AddMember("stepTimings", vStepTimings, allocator);
     }
 }
 
@@ -159,6 +177,13 @@ Job::fromString(std::string data)
         filter = StringUtils::trim(doc["filter"].GetString());
     }
 
+    if (doc.HasMember("force")) {
+        if (!doc["force"].IsBool()) {
+            throw std::invalid_argument("Key force should be a boolean");
+        }
+        force = doc["force"].GetBool();
+    }
+
     if (doc.HasMember("attributeSets")) {
         auto & vAttributeSets = doc["attributeSets"];
         if (!vAttributeSets.IsArray()) {
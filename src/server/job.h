@@ -11,11 +11,18 @@
 #include <iostream>
 #include <memory>
 #include <chrono>
+#include <utility>
+#include <mutex>
 
 
 namespace Batyr
 {
 
+    /**
+     * a job is modified by the worker processing it - for asynchronously
+     * executed jobs by the thread of the executor - while it is read by the
+     * HTTP handlers. All access to its mutable state is serialized by a mutex.
+     */
     class Job
     {
         public:
@@ -41,8 +48,9 @@ namespace Batyr
 
             void setStatus(Status _status)
             {
+                std::lock_guard<std::mutex> lock(mutex);
                 status = _status;
-                if (isDone()) {
+                if (isDoneUnlocked()) {
                     timeFinished = std::chrono::system_clock::now();
                 }
             }
@@ -59,11 +67,13 @@ namespace Batyr
 
             std::chrono::system_clock::time_point getTimeFinished()
             {
+                std::lock_guard<std::mutex> lock(mutex);
                 return timeFinished;
             }
 
             void setMessage(const std::string & m)
             {
+                std::lock_guard<std::mutex> lock(mutex);
                 message = m;
             }
 
@@ -77,8 +87,28 @@ namespace Batyr
                 return filter;
             }
 
+            /**
+             * pull the source even when it did not change since the
+             * last pull
+             */
+            bool getForce() const
+            {
+                return force;
+            }
+
+            /**
+             * the job did not need to do anything as the source did not
+             * change since the last pull
+             */
+            void setSkipped(bool _skipped)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                skipped = _skipped;
+            }
+
             Job::Status getStatus() const
             {
+                std::lock_guard<std::mutex> lock(mutex);
                 return status;
             }
 
@@ -87,7 +117,8 @@ namespace Batyr
              */
             bool isDone() const
             {
-                return (status == FINISHED) || (status == FAILED);
+                std::lock_guard<std::mutex> lock(mutex);
+                return isDoneUnlocked();
             }
 
             /**
@@ -104,6 +135,7 @@ namespace Batyr
 
             void setStatistics(int _numPulled, int _numCreated, int _numUpdated, int _numDeleted, int _numIgnored = 0)
             {
+                std::lock_guard<std::mutex> lock(mutex);
                 numPulled = _numPulled;
                 numCreated = _numCreated;
                 numUpdated = _numUpdated;
@@ -111,6 +143,26 @@ namespace Batyr
                 numIgnored = _numIgnored;
             }
 
+            /**
+             * size in bytes of the unchanged values of the updated rows
+             * which have been kept instead of being written again
+             */
+            void setNumBytesKept(long long _numBytesKept)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                numBytesKept = _numBytesKept;
+            }
+
+            /**
+             * record the duration of a step of the job in milliseconds.
+             * Steps are reported in the order they have been recorded.
+             */
+            void addStepTiming(const std::string & step, double milliseconds)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stepTimings.push_back(std::make_pair(step, milliseconds));
+            }
+
             Job::Type getType() const
             {
                 return type;
@@ -123,10 +175,20 @@ namespace Batyr
 
         private:
 
+            /** isDone for callers already holding the mutex */
+            bool isDoneUnlocked() const
+            {
+                return (status == FINISHED) || (status == FAILED);
+            }
+
+            mutable std::mutex mutex;
+
             Job::Type type;
             std::string message;
             std::string layerName;
             std::string filter;
+            bool force;
+            bool skipped;
             std::string id;
             Job::Status status;
             std::chrono::system_clock::time_point timeAdded;
@@ -140,6 +202,11 @@ namespace Batyr
             int numPulled;
             int numIgnored;
 
+            // -1 when the server is not able to report it
+            long long numBytesKept;
+
+            // duration of the steps of the job
+            std::vector<std::pair<std::string, double>> stepTimings;
 
     };
 
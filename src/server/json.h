@@ -37,7 +37,7 @@ namespace Json
      * to a serialized JSON document
      **/
     template <class T>
-    std::string toJson(T c)
+    std::string toJson(const T & c)
     {
         rapidjson::Document data;
         c.toJsonValue(data, data.GetAllocator());
@@ -0,0 +1,80 @@
+#ifndef __batyr_rowdigest_h__
+#define __batyr_rowdigest_h__
+
+#include <cstddef>
+#include <cstdint>
+
+#include "server/db/queryvalue.h"
+
+
+namespace Batyr
+{
+
+    /**
+     * 64bit FNV-1a hash over the values of a row. Used to detect changed
+     * rows by comparing a single column instead of all columns of a row.
+     *
+     * This is not a cryptographic hash.
+     */
+    class RowDigest
+    {
+        private:
+            uint64_t hash;
+
+        public:
+            RowDigest()
+                :   hash(14695981039346656037ull)
+            {};
+
+            void update(const void * data, size_t length)
+            {
+                const unsigned char * bytes = static_cast<const unsigned char *>(data);
+                for (size_t i=0; i<length; i++) {
+                    hash ^= bytes[i];
+                    hash *= 1099511628211ull;
+                }
+            }
+
+            /**
+             * add a value prefixed by its length, so consecutive
+             * values can not be confused.
+             */
+            void updateValue(const void * data, int32_t length)
+            {
+                // independent of the byte order of the host
+                const uint32_t ulength = static_cast<uint32_t>(length);
+                const unsigned char lengthBytes[4] = {
+                    static_cast<unsigned char>(ulength),
+                    static_cast<unsigned char>(ulength >> 8),
+                    static_cast<unsigned char>(ulength >> 16),
+                    static_cast<unsigned char>(ulength >> 24)
+                };
+                update(lengthBytes, sizeof(lengthBytes));
+                if (length > 0) {
+                    update(data, length);
+                }
+            }
+
+            void updateValue(const QueryValue & value)
+            {
+                if (value.isNull()) {
+                    updateValue(nullptr, -1);
+                }
+                else {
+                    const auto & v = value.getRef();
+                    updateValue(v.data(), static_cast<int32_t>(v.size()));
+                }
+            }
+
+            /**
+             * the digest as stored in a bigint column
+             */
+            int64_t get() const
+            {
+                return static_cast<int64_t>(hash);
+            }
+    };
+
+};
+
+#endif // __batyr_rowdigest_h__
@@ -0,0 +1,138 @@
+#include <Poco/File.h>
+#include <Poco/Path.h>
+#include <Poco/Exception.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include "server/sourcefingerprint.h"
+#include "server/rowdigest.h"
+
+using namespace Batyr;
+
+
+/** size of the chunks files get read in when hashing their contents */
+static const size_t contentChunkSize = 64 * 1024;
+
+
+/**
+ * hash the contents of a file. Returns false when the file
+ * could not be read.
+ */
+static bool
+hashFileContents(const std::string & path, int64_t & hash)
+{
+    std::ifstream ifs(path, std::ios::in | std::ios::binary);
+    if (!ifs) {
+        return false;
+    }
+
+    RowDigest digest;
+    std::vector<char> buffer(contentChunkSize);
+    while (ifs) {
+        ifs.read(buffer.data(), buffer.size());
+        digest.update(buffer.data(), static_cast<size_t>(ifs.gcount()));
+    }
+    if (ifs.bad()) {
+        return false;
+    }
+    hash = digest.get();
+    return true;
+}
+
+
+std::string
+SourceFingerprint::compute(const Layer & layer, const std::string & filter)
+{
+    if (layer.source_fingerprint == FINGERPRINT_NONE) {
+        return "";
+    }
+
+    // collect the files making up the source
+    std::vector<Poco::File> files;
+    try {
+        Poco::File source(layer.source);
+        if (!source.exists()) {
+            // connection strings of databases or webservices
+            return "";
+        }
+
+        if (source.isDirectory()) {
+            source.list(files);
+        }
+        else {
+            Poco::Path sourcePath(layer.source);
+            std::string prefix = sourcePath.getBaseName() + ".";
+
+            std::vector<Poco::File> siblings;
+            Poco::File(Poco::Path(sourcePath).makeAbsolute().makeParent()).list(siblings);
+            for (const auto & sibling : siblings) {
+                if (Poco::Path(sibling.path()).getFileName().compare(0, prefix.size(), prefix) == 0) {
+                    files.push_back(sibling);
+                }
+            }
+        }
+    }
+    catch (Poco::Exception &) {
+        // the source can not be inspected, so it has to be pulled
+        return "";
+    }
+
+    std::sort(files.begin(), files.end(), [](const Poco::File & a, const Poco::File & b) {
+        return a.path() < b.path();
+    });
+
+    std::stringstream fingerprint;
+    fingerprint << "filter=" << filter.size() << ":" << filter;
+    try {
+        for (const auto & file : files) {
+            if (!file.isFile()) {
+                continue;
+            }
+            fingerprint << ";" << file.path()
+                        << ":" << file.getSize()
+                        << ":" << file.getLastModified().epochMicroseconds();
+
+            if (layer.source_fingerprint == FINGERPRINT_CONTENT) {
+                int64_t hash = 0;
+                if (!hashFileContents(file.path(), hash)) {
+                    return "";
+                }
+                fingerprint << ":" << hash;
+            }
+        }
+    }
+    catch (Poco::Exception &) {
+        // files removed while inspecting them
+        return "";
+    }
+    return fingerprint.str();
+}
+
+
+bool
+SourceFingerprintCache::matches(const std::string & layerName, const std::string & fingerprint)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = fingerprints.find(layerName);
+    return (it != fingerprints.end()) && (it->second == fingerprint);
+}
+
+
+void
+SourceFingerprintCache::set(const std::string & layerName, const std::string & fingerprint)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    fingerprints[layerName] = fingerprint;
+}
+
+
+void
+SourceFingerprintCache::remove(const std::string & layerName)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    fingerprints.erase(layerName);
+}
@@ -0,0 +1,63 @@
+#ifndef __batyr_sourcefingerprint_h__
+#define __batyr_sourcefingerprint_h__
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "server/configuration.h"
+
+
+namespace Batyr
+{
+
+    namespace SourceFingerprint
+    {
+        /**
+         * build a fingerprint of the source of a layer and the filter used to
+         * read it.
+         *
+         * Only sources which are files or directories have a fingerprint. It
+         * consists of the names, the sizes and the modification times of the
+         * files - and when requested of a hash of their contents. For a file
+         * all files in the same directory which share its base name are
+         * included, so the sidecar files of a shapefile are covered as well.
+         *
+         * Returns an empty string when the source has no fingerprint.
+         */
+        std::string compute(const Layer & layer, const std::string & filter);
+    };
+
+
+    /**
+     * the fingerprints of the sources of the last successful pulls of
+     * the layers. Shared by all workers.
+     */
+    class SourceFingerprintCache
+    {
+        private:
+            std::map<std::string, std::string> fingerprints;
+            std::mutex mutex;
+
+        public:
+            /**
+             * true if the last successful pull of the layer used a source
+             * with the same fingerprint
+             */
+            bool matches(const std::string & layerName, const std::string & fingerprint);
+
+            void set(const std::string & layerName, const std::string & fingerprint);
+
+            /**
+             * forget the fingerprint of a layer. Used when the target table
+             * gets modified by other means than a pull.
+             */
+            void remove(const std::string & layerName);
+
+            typedef std::shared_ptr<SourceFingerprintCache> Ptr;
+    };
+
+};
+
+#endif // __batyr_sourcefingerprint_h__
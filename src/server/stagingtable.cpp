@@ -0,0 +1,127 @@
+#include "server/stagingtable.h"
+#include "server/rowdigest.h"
+
+#include <sstream>
+#include <vector>
+
+using namespace Batyr;
+
+
+/** marks the tables created by batyrd, so only these are removed as orphans */
+static const char * tableComment = "batyr staging table";
+
+
+/**
+ * key of the advisory lock held while the table exists
+ */
+static std::string
+lockKey(const std::string & schema, const std::string & name)
+{
+    RowDigest digest;
+    digest.updateValue(tableComment, static_cast<int32_t>(std::char_traits<char>::length(tableComment)));
+    digest.updateValue(schema.data(), static_cast<int32_t>(schema.size()));
+    digest.updateValue(name.data(), static_cast<int32_t>(name.size()));
+    return std::to_string(digest.get());
+}
+
+
+SharedStagingTable::SharedStagingTable(Db::Connection & _db, const std::string & _schema, const std::string & _name)
+    :   logger(Poco::Logger::get("SharedStagingTable")),
+        db(_db),
+        schema(_schema),
+        name(_name),
+        created(false)
+{
+}
+
+
+SharedStagingTable::~SharedStagingTable()
+{
+    if (!created) {
+        return;
+    }
+
+    try {
+        {
+            auto transaction = db.getTransaction();
+            transaction->exec("drop table if exists " + quotedTable);
+        }
+
+        // the lock is only released after the drop has been committed
+        auto transaction = db.getTransaction();
+        transaction->execParams("select pg_advisory_unlock($1::bigint)",
+                    { QueryValue(lockKey(schema, name)) });
+    }
+    catch (std::exception & e) {
+        // the table will be removed by removeOrphans once the
+        // connection has been closed
+        poco_warning(logger, "Could not drop the staging table " + quotedTable + ": " + e.what());
+    }
+}
+
+
+void
+SharedStagingTable::create(const std::string & targetSchema, const std::string & targetTable)
+{
+    if (db.getVersion() < 90100) {
+        throw Db::DbError("staging tables in a schema require postgresql 9.1 or later");
+    }
+
+    auto transaction = db.getTransaction();
+    quotedTable = transaction->quoteAndJoinIdent(schema, name);
+
+    // lock before the table becomes visible to removeOrphans
+    transaction->execParams("select pg_advisory_lock($1::bigint)",
+                { QueryValue(lockKey(schema, name)) });
+    created = true;
+
+    poco_debug(logger, "creating table " + quotedTable + " based on " + targetTable);
+
+    std::stringstream createStmt;
+    createStmt  << "create unlogged table " << quotedTable
+                << " as select * from " << transaction->quoteAndJoinIdent(targetSchema, targetTable)
+                << " limit 0";
+    transaction->exec(createStmt.str());
+    transaction->exec("comment on table " + quotedTable + " is '" + tableComment + "'");
+}
+
+
+void
+SharedStagingTable::removeOrphans(Db::Connection & db, const std::set<std::string> & schemas)
+{
+    auto & logger = Poco::Logger::get("SharedStagingTable");
+
+    for (const auto & schema : schemas) {
+        std::vector<std::string> tableNames;
+        {
+            auto transaction = db.getTransaction();
+            auto res = transaction->execParams(
+                        "select c.relname::text"
+                        "    from pg_catalog.pg_class c"
+                        "    join pg_catalog.pg_namespace n on n.oid = c.relnamespace"
+                        "    where n.nspname = $1::text and c.relkind = 'r' and c.relpersistence = 'u'"
+                        "        and pg_catalog.obj_description(c.oid, 'pg_class') = $2::text",
+                        { QueryValue(schema), QueryValue(std::string(tableComment)) });
+            for (int i=0; i<PQntuples(res.get()); i++) {
+                tableNames.push_back(std::string(PQgetvalue(res.get(), i, 0)));
+            }
+        }
+
+        for (const auto & tableName : tableNames) {
+            // tables still locked belong to running pulls - possibly of other
+            // instances of batyrd using the same database
+            auto transaction = db.getTransaction();
+            auto lockRes = transaction->execParams("select pg_try_advisory_xact_lock($1::bigint)::text",
+                        { QueryValue(lockKey(schema, tableName)) });
+            bool locked = (std::string(PQgetvalue(lockRes.get(), 0, 0)) == "true");
+            lockRes.reset(NULL);
+            if (!locked) {
+                continue;
+            }
+
+            std::string quotedTable = transaction->quoteAndJoinIdent(schema, tableName);
+            poco_information(logger, "Removing the orphaned staging table " + quotedTable);
+            transaction->exec("drop table if exists " + quotedTable);
+        }
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef __batyr_stagingtable_h__
+#define __batyr_stagingtable_h__
+
+#include <Poco/Logger.h>
+
+#include <set>
+#include <string>
+
+#include "server/db/connection.h"
+
+
+namespace Batyr
+{
+
+    /**
+     * an unlogged regular table in a dedicated schema used as the staging
+     * table of a pull instead of a temporary table.
+     *
+     * Other than temporary tables it is visible to all connections once it
+     * has been created, so it may be loaded by several connections and can
+     * be read by parallel workers of postgresql. The table is created and
+     * dropped in transactions of their own - the pull itself runs in a
+     * transaction in between.
+     *
+     * While the table exists the connection which created it holds a session
+     * level advisory lock for it. When batyrd crashes or the connection is
+     * lost the lock is released by postgresql and removeOrphans will drop
+     * the table the next time batyrd starts.
+     */
+    class SharedStagingTable
+    {
+        private:
+            Poco::Logger & logger;
+            Db::Connection & db;
+
+            std::string schema;
+            std::string name;
+
+            /** "schema"."table" */
+            std::string quotedTable;
+
+            bool created;
+
+        public:
+            SharedStagingTable(Db::Connection & _db, const std::string & _schema, const std::string & _name);
+
+            /** drops the table. Errors are only logged. */
+            ~SharedStagingTable();
+
+            /** disable copying */
+            SharedStagingTable(const SharedStagingTable &) = delete;
+            SharedStagingTable& operator=(const SharedStagingTable &) = delete;
+
+            /**
+             * create the table with the columns of the target table
+             * and commit it
+             */
+            void create(const std::string & targetSchema, const std::string & targetTable);
+
+            /** the schema-qualified and quoted name of the table */
+            const std::string & getQuotedTable() const
+            {
+                return quotedTable;
+            }
+
+            /**
+             * drop the staging tables in the schemas which are not locked
+             * by any connection anymore. These are the leftovers of pulls
+             * which have been interrupted by a crash.
+             */
+            static void removeOrphans(Db::Connection & db, const std::set<std::string> & schemas);
+    };
+
+};
+
+#endif // __batyr_stagingtable_h__
@@ -0,0 +1,324 @@
+#include "server/syncstatements.h"
+#include "common/stringutils.h"
+
+#include <sstream>
+
+using namespace Batyr;
+
+
+SyncStatements::SyncStatements(Db::Transaction & _transaction, const std::string & targetSchema,
+            const std::string & targetTable, const std::string & tempSchema,
+            const std::string & tempTable,
+            const std::vector<std::string> & primaryKeyColumns,
+            const std::vector<std::string> & insertColumns,
+            const Db::FieldMap & tableFields)
+    :   transaction(_transaction),
+        quotedTargetTable(_transaction.quoteAndJoinIdent(targetSchema, targetTable)),
+        quotedTargetName(_transaction.quoteIdent(targetTable)),
+        quotedTempTable(tempSchema.empty() ? _transaction.quoteIdent(tempTable)
+                                           : _transaction.quoteAndJoinIdent(tempSchema, tempTable)),
+        quotedTempName(_transaction.quoteIdent(tempTable)),
+        quotedPrimaryKeyColumns(_transaction.quoteIdent(primaryKeyColumns)),
+        quotedInsertColumns(StringUtils::join(_transaction.quoteIdent(insertColumns), ", "))
+{
+    for (const auto & primaryKeyColumn : primaryKeyColumns) {
+        auto tableField = tableFields.find(primaryKeyColumn);
+        if ((tableField != tableFields.end()) && tableField->second.isNotNull) {
+            keyOperators.push_back(" = ");
+        }
+        else {
+            keyOperators.push_back(" is not distinct from ");
+        }
+    }
+
+    for (const auto & tableFieldPair : tableFields) {
+        if (tableFieldPair.second.pgTypeName == "geometry") {
+            geometryColumns.insert(tableFieldPair.first);
+        }
+        if (tableFieldPair.second.isToastable) {
+            toastableColumns.insert(tableFieldPair.first);
+        }
+    }
+}
+
+
+std::string
+SyncStatements::keyCondition() const
+{
+    std::stringstream condition;
+    for (size_t i=0; i<quotedPrimaryKeyColumns.size(); i++) {
+        if (i != 0) {
+            condition << " and ";
+        }
+        condition   << quotedTargetName << "." << quotedPrimaryKeyColumns[i]
+                    << keyOperators[i]
+                    << quotedTempName << "." << quotedPrimaryKeyColumns[i];
+    }
+    return condition.str();
+}
+
+
+std::string
+SyncStatements::quotedTempColumn(const std::string & column) const
+{
+    return quotedTempName + "." + transaction.quoteIdent(column);
+}
+
+
+std::vector<SyncStatements::GeometryComparison>
+SyncStatements::geometryComparisons(const std::string & column, const Db::PostGis::VersionTuple & versionPostgis,
+            const std::string & quotedTarget) const
+{
+    std::string quotedColumn = transaction.quoteIdent(column);
+    std::string quotedTargetGeom = quotedTarget + "." + quotedColumn;
+    std::string quotedTempGeom = quotedTempName + "." + quotedColumn;
+
+    std::vector<GeometryComparison> comparisons;
+
+    // the vast majority of the geometries usually did not change at all
+    comparisons.push_back({"binary identical",
+                quotedTargetGeom + "::bytea is not distinct from " + quotedTempGeom + "::bytea", false});
+
+    comparisons.push_back({"null",
+                quotedTargetGeom + " is null or " + quotedTempGeom + " is null", true});
+
+    // MEMO: geometries with different SRIDs can not be compared with the "=" operator
+    comparisons.push_back({"srid",
+                "st_srid(" + quotedTargetGeom + ") != st_srid(" + quotedTempGeom + ")", true});
+
+    // geometries with different bounding boxes can not be equal. Starting with postgis 1.5
+    // "~=" compares the bounding boxes, before it was an exact comparison of the geometries
+    // which can not be used here. Empty geometries do not have a bounding box.
+    int postgisMajor = std::get<0>(versionPostgis);
+    int postgisMinor = std::get<1>(versionPostgis);
+    if ((postgisMajor > 1) || ((postgisMajor == 1) && (postgisMinor >= 5))) {
+        comparisons.push_back({"bounding box",
+                    "not st_isempty(" + quotedTargetGeom + ") and not st_isempty(" + quotedTempGeom + ")"
+                    " and not (" + quotedTargetGeom + " ~= " + quotedTempGeom + ")", true});
+    }
+
+    // MEMO: collections can not be compared with st_equals. As they are not binary
+    // identical they are treated as changed.
+    if (postgisMajor >= 2) {
+        // st_iscollection is only supported starting with postgis 2.0
+        comparisons.push_back({"collection",
+                    "st_iscollection(" + quotedTargetGeom + ") or st_iscollection(" + quotedTempGeom + ")", true});
+    }
+    else {
+        comparisons.push_back({"collection",
+                    "st_geometrytype(" + quotedTargetGeom + ") = 'ST_GeometryCollection'"
+                    " or st_geometrytype(" + quotedTargetGeom + ") like 'ST_Multi%'"
+                    " or st_geometrytype(" + quotedTempGeom + ") = 'ST_GeometryCollection'"
+                    " or st_geometrytype(" + quotedTempGeom + ") like 'ST_Multi%'", true});
+    }
+    return comparisons;
+}
+
+
+std::string
+SyncStatements::geometryChanged(const std::string & column, const Db::PostGis::VersionTuple & versionPostgis,
+            const std::string & quotedTarget) const
+{
+    std::string quotedColumn = transaction.quoteIdent(column);
+
+    std::stringstream condition;
+    condition << "(case";
+    for (const auto & comparison : geometryComparisons(column, versionPostgis, quotedTarget)) {
+        condition   << " when " << comparison.condition
+                    << " then " << (comparison.changed ? "true" : "false");
+    }
+    condition   << " else not st_equals(" << quotedTarget << "." << quotedColumn << ", "
+                << quotedTempName << "." << quotedColumn << ")"
+                << " end)";
+    return condition.str();
+}
+
+
+std::string
+SyncStatements::geometryChanged(const std::string & column, const Db::PostGis::VersionTuple & versionPostgis) const
+{
+    return geometryChanged(column, versionPostgis, quotedTargetName);
+}
+
+
+std::string
+SyncStatements::columnChanged(const std::string & column, const Db::PostGis::VersionTuple & versionPostgis,
+            const std::string & quotedTarget) const
+{
+    if (geometryColumns.count(column) != 0) {
+        return geometryChanged(column, versionPostgis, quotedTarget);
+    }
+
+    std::string quotedColumn = transaction.quoteIdent(column);
+    return "(" + quotedTarget + "." + quotedColumn + " is distinct from "
+            + quotedTempName + "." + quotedColumn + ")";
+}
+
+
+std::string
+SyncStatements::columnChanged(const std::string & column, const Db::PostGis::VersionTuple & versionPostgis) const
+{
+    return columnChanged(column, versionPostgis, quotedTargetName);
+}
+
+
+std::string
+SyncStatements::changedCondition(const std::vector<std::string> & updateColumns, const std::string & digestColumn,
+            const Db::PostGis::VersionTuple & versionPostgis) const
+{
+    if (!digestColumn.empty()) {
+        // the digest changes whenever any of the values changes
+        return columnChanged(digestColumn, versionPostgis);
+    }
+
+    std::stringstream condition;
+    for (size_t i=0; i<updateColumns.size(); i++) {
+        if (i != 0) {
+            condition << " or ";
+        }
+        condition << columnChanged(updateColumns[i], versionPostgis);
+    }
+    return condition.str();
+}
+
+
+std::string
+SyncStatements::columnIdentical(const std::string & column, const std::string & quotedTarget) const
+{
+    std::string quotedColumn = transaction.quoteIdent(column);
+    if (geometryColumns.count(column) != 0) {
+        return "(" + quotedTarget + "." + quotedColumn + "::bytea is not distinct from "
+                + quotedTempName + "." + quotedColumn + "::bytea)";
+    }
+    return "(" + quotedTarget + "." + quotedColumn + " is not distinct from "
+            + quotedTempName + "." + quotedColumn + ")";
+}
+
+
+std::string
+SyncStatements::columnAssignment(const std::string & column) const
+{
+    std::string quotedColumn = transaction.quoteIdent(column);
+
+    std::stringstream assignment;
+    assignment << quotedColumn << " = ";
+    if (toastableColumns.count(column) == 0) {
+        // values of fixed-length types are always stored in the row itself
+        assignment  << quotedTempName << "." << quotedColumn;
+    }
+    else {
+        assignment  << "case when " << columnIdentical(column, quotedTargetName)
+                    << " then " << quotedTargetName << "." << quotedColumn
+                    << " else " << quotedTempName << "." << quotedColumn << " end";
+    }
+    return assignment.str();
+}
+
+
+std::string
+SyncStatements::unchangedBytes(const std::vector<std::string> & updateColumns, const std::string & quotedTarget) const
+{
+    std::stringstream expression;
+    expression << "(0";
+    for (const auto & column : updateColumns) {
+        if (toastableColumns.count(column) == 0) {
+            continue;
+        }
+        expression  << " + (case when " << columnIdentical(column, quotedTarget)
+                    << " then coalesce(pg_column_size("
+                    << quotedTarget << "." << transaction.quoteIdent(column) << "), 0) else 0 end)::bigint";
+    }
+    expression << ")::bigint";
+    return expression.str();
+}
+
+
+std::string
+SyncStatements::unchangedBytesStats(const std::vector<std::string> & updateColumns, const std::string & digestColumn,
+            const Db::PostGis::VersionTuple & versionPostgis) const
+{
+    std::stringstream stmt;
+    stmt    << "select count(*), coalesce(sum(" << unchangedBytes(updateColumns, quotedTargetName) << "), 0)"
+            << " from " << quotedTargetTable
+            << " join " << quotedTempTable << " on " << keyCondition()
+            << " where " << changedCondition(updateColumns, digestColumn, versionPostgis);
+    return stmt.str();
+}
+
+
+std::string
+SyncStatements::geometryComparisonStats(const std::string & column, const Db::PostGis::VersionTuple & versionPostgis) const
+{
+    std::stringstream stmt;
+    stmt << "select comparison, count(*) from (select case";
+    for (const auto & comparison : geometryComparisons(column, versionPostgis, quotedTargetName)) {
+        stmt << " when " << comparison.condition << " then '" << comparison.name << "'";
+    }
+    stmt    << " else 'st_equals' end as comparison"
+            << " from " << quotedTargetTable
+            << " join " << quotedTempTable << " on " << keyCondition()
+            << ") comparisons group by comparison order by count(*) desc";
+    return stmt.str();
+}
+
+
+std::string
+SyncStatements::insertMissing() const
+{
+    std::stringstream stmt;
+    stmt    << "insert into " << quotedTargetTable
+            << " (" << quotedInsertColumns << ")"
+            << " select " << quotedInsertColumns
+            << " from " << quotedTempTable
+            << " where not exists ("
+            << "select 1 from " << quotedTargetTable
+            << " where " << keyCondition()
+            << ")";
+    return stmt.str();
+}
+
+
+std::string
+SyncStatements::deleteRemoved() const
+{
+    std::stringstream stmt;
+    stmt    << "delete from " << quotedTargetTable
+            << " where not exists ("
+            << "select 1 from " << quotedTempTable
+            << " where " << keyCondition()
+            << ")";
+    return stmt.str();
+}
+
+
+std::string
+SyncStatements::insertMissingNotIn() const
+{
+    auto quotedPrimaryKeyColumnsStr = StringUtils::join(quotedPrimaryKeyColumns, ", ");
+
+    std::stringstream stmt;
+    stmt    << "insert into " << quotedTargetTable
+            << " (" << quotedInsertColumns << ")"
+            << " select " << quotedInsertColumns
+            << " from " << quotedTempTable
+            << " where (" << quotedPrimaryKeyColumnsStr << ") not in ("
+            << "select " << quotedPrimaryKeyColumnsStr
+            << " from " << quotedTargetTable
+            << ")";
+    return stmt.str();
+}
+
+
+std::string
+SyncStatements::deleteRemovedNotIn() const
+{
+    auto quotedPrimaryKeyColumnsStr = StringUtils::join(quotedPrimaryKeyColumns, ", ");
+
+    std::stringstream stmt;
+    stmt    << "delete from " << quotedTargetTable
+            << " where (" << quotedPrimaryKeyColumnsStr << ") not in ("
+            << "select " << quotedPrimaryKeyColumnsStr
+            << " from " << quotedTempTable
+            << ")";
+    return stmt.str();
+}
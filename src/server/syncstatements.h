@@ -0,0 +1,206 @@
+#ifndef __batyr_syncstatements_h__
+#define __batyr_syncstatements_h__
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "server/db/transaction.h"
+#include "server/db/field.h"
+#include "server/db/postgis.h"
+
+
+namespace Batyr
+{
+
+    /**
+     * builds the sql statements synchronizing the target table of a layer
+     * with its staging table.
+     *
+     * Rows of both tables are matched by their primary key columns using the
+     * semantics of "is not distinct from". For columns of the target table
+     * which are defined as "not null" the plain "=" operator is used instead
+     * as it yields the same result there and allows postgresql to use hash
+     * and merge joins.
+     * Missing and removed rows are found using "not exists" anti-joins. The
+     * "(...) not in (select ...)" form is only kept to be able to compare
+     * both plans - postgresql can not execute it as a hashed anti-join when
+     * the key spans multiple columns or contains nullable columns.
+     */
+    class SyncStatements
+    {
+        private:
+            Db::Transaction & transaction;
+
+            /** "schema"."table" */
+            std::string quotedTargetTable;
+
+            /** "table" - to qualify the columns of the target table */
+            std::string quotedTargetName;
+
+            /** "table" or "schema"."table" when the staging table is not a temporary table */
+            std::string quotedTempTable;
+
+            /** "table" - to qualify the columns of the staging table */
+            std::string quotedTempName;
+
+            std::vector<std::string> quotedPrimaryKeyColumns;
+
+            /** "=" or "is not distinct from" for each primary key column */
+            std::vector<const char *> keyOperators;
+
+            std::string quotedInsertColumns;
+
+            /** the columns of the target table of the type geometry */
+            std::set<std::string> geometryColumns;
+
+            /** the columns of the target table which values may be stored out of line */
+            std::set<std::string> toastableColumns;
+
+            struct GeometryComparison
+            {
+                /** name of the case in the statistics of geometryComparisonStats */
+                const char * name;
+                std::string condition;
+                bool changed;
+            };
+
+            /**
+             * the ordered cases of comparing the geometries of a column. The
+             * first matching case decides if the geometry changed. Geometries
+             * not matching any case are compared using st_equals.
+             */
+            std::vector<GeometryComparison> geometryComparisons(const std::string & column,
+                        const Db::PostGis::VersionTuple & versionPostgis,
+                        const std::string & quotedTarget) const;
+
+            std::string geometryChanged(const std::string & column,
+                        const Db::PostGis::VersionTuple & versionPostgis,
+                        const std::string & quotedTarget) const;
+
+            std::string columnChanged(const std::string & column,
+                        const Db::PostGis::VersionTuple & versionPostgis,
+                        const std::string & quotedTarget) const;
+
+            /**
+             * cheap condition which is true when the value of the column is
+             * identical in the target and the staging table. Geometries are
+             * compared by their binary representation, so equal geometries
+             * which are not binary identical do not match.
+             */
+            std::string columnIdentical(const std::string & column,
+                        const std::string & quotedTarget) const;
+
+        public:
+            SyncStatements(Db::Transaction & transaction, const std::string & targetSchema,
+                        const std::string & targetTable, const std::string & tempSchema,
+                        const std::string & tempTable,
+                        const std::vector<std::string> & primaryKeyColumns,
+                        const std::vector<std::string> & insertColumns,
+                        const Db::FieldMap & tableFields);
+
+            /**
+             * condition matching a row of the target table with a row of the
+             * staging table
+             */
+            std::string keyCondition() const;
+
+            /**
+             * the staging table - to be used in the FROM or USING clause of
+             * statements joining it with the target table
+             */
+            const std::string & getQuotedTempTable() const
+            {
+                return quotedTempTable;
+            }
+
+            /**
+             * a column of the staging table qualified the same way as in the
+             * conditions and assignments built here
+             */
+            std::string quotedTempColumn(const std::string & column) const;
+
+            /**
+             * condition which is true when the geometry of the column differs
+             * between the target and the staging table.
+             *
+             * The expensive st_equals is only used when the geometries are
+             * neither binary identical nor differ in simpler properties like
+             * their bounding boxes.
+             */
+            std::string geometryChanged(const std::string & column,
+                        const Db::PostGis::VersionTuple & versionPostgis) const;
+
+            /**
+             * condition which is true when the value of the column differs
+             * between the target and the staging table
+             */
+            std::string columnChanged(const std::string & column,
+                        const Db::PostGis::VersionTuple & versionPostgis) const;
+
+            /**
+             * condition which is true when a row of the target table needs to be
+             * updated. With a digest column only the digests get compared.
+             */
+            std::string changedCondition(const std::vector<std::string> & updateColumns,
+                        const std::string & digestColumn,
+                        const Db::PostGis::VersionTuple & versionPostgis) const;
+
+            /**
+             * assignment of the column for the update of a changed row.
+             * Toastable columns which are identical keep their current value,
+             * so large values stored out of line (TOAST) are neither copied
+             * nor written to the WAL again. This is decided using
+             * columnIdentical instead of the more expensive columnChanged,
+             * which is evaluated once per row by the changed condition.
+             */
+            std::string columnAssignment(const std::string & column) const;
+
+            /**
+             * expression of the size in bytes of the values of the columns which
+             * are kept by the update of a row - see columnAssignment. quotedTarget
+             * qualifies the current values of the target table - "old" in the
+             * RETURNING clause.
+             */
+            std::string unchangedBytes(const std::vector<std::string> & updateColumns,
+                        const std::string & quotedTarget) const;
+
+            /**
+             * query returning the number of rows to update and the size in
+             * bytes of their values which are kept
+             */
+            std::string unchangedBytesStats(const std::vector<std::string> & updateColumns,
+                        const std::string & digestColumn,
+                        const Db::PostGis::VersionTuple & versionPostgis) const;
+
+            /**
+             * query counting how many of the joined rows of the target and the
+             * staging table are decided by each case of geometryChanged. The
+             * row with the case "st_equals" is the number of calls to st_equals.
+             */
+            std::string geometryComparisonStats(const std::string & column,
+                        const Db::PostGis::VersionTuple & versionPostgis) const;
+
+            /**
+             * insert the rows of the staging table which are missing in the
+             * target table
+             */
+            std::string insertMissing() const;
+
+            /**
+             * delete the rows of the target table which are not part of the
+             * staging table
+             */
+            std::string deleteRemoved() const;
+
+            /**
+             * the previous "not in" forms of insertMissing and deleteRemoved.
+             * Only used to compare the query plans.
+             */
+            std::string insertMissingNotIn() const;
+            std::string deleteRemovedNotIn() const;
+    };
+
+};
+
+#endif // __batyr_syncstatements_h__
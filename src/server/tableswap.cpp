@@ -0,0 +1,272 @@
+#include "server/tableswap.h"
+#include "server/worker.h"
+#include "common/stringutils.h"
+
+using namespace Batyr;
+
+
+/**
+ * properties of a table which prevent it from being swapped. $1 is the table.
+ */
+static const char * checkSql =
+        "select 'is referenced by the foreign key ' || quote_ident(c.conname) || ' of ' || c.conrelid::regclass::text"
+        "    from pg_catalog.pg_constraint c"
+        "    where c.contype = 'f' and c.confrelid = $1::text::regclass and c.conrelid <> c.confrelid"
+        " union all"
+        " select 'has the trigger ' || quote_ident(t.tgname)"
+        "    from pg_catalog.pg_trigger t"
+        "    where t.tgrelid = $1::text::regclass and not t.tgisinternal"
+        " union all"
+        " select 'has the identity column ' || quote_ident(a.attname)"
+        "    from pg_catalog.pg_attribute a"
+        "    where a.attrelid = $1::text::regclass and a.attnum > 0 and not a.attisdropped and a.attidentity <> ''"
+        " union all"
+        " select 'has the exclusion constraint ' || quote_ident(c.conname)"
+        "    from pg_catalog.pg_constraint c"
+        "    where c.conrelid = $1::text::regclass and c.contype = 'x'"
+        " union all"
+        " select 'is used by the materialized view ' || v.oid::regclass::text"
+        "    from pg_catalog.pg_depend d"
+        "    join pg_catalog.pg_rewrite r on r.oid = d.objid"
+        "    join pg_catalog.pg_class v on v.oid = r.ev_class"
+        "    where d.classid = 'pg_catalog.pg_rewrite'::regclass and d.refobjid = $1::text::regclass and v.relkind = 'm'"
+        " union all"
+        " select 'has the rule ' || quote_ident(r.rulename)"
+        "    from pg_catalog.pg_rewrite r"
+        "    where r.ev_class = $1::text::regclass"
+        " union all"
+        " select 'is partitioned or part of a table inheritance'"
+        "    from pg_catalog.pg_class c"
+        "    where c.oid = $1::text::regclass and (c.relkind <> 'r' or exists ("
+        "        select 1 from pg_catalog.pg_inherits i where i.inhrelid = c.oid or i.inhparent = c.oid))"
+        " union all"
+        " select 'has row level security policies'"
+        "    where exists (select 1 from pg_catalog.pg_policy p where p.polrelid = $1::text::regclass)"
+        " union all"
+        " select 'is part of the publication ' || quote_ident(p.pubname)"
+        "    from pg_catalog.pg_publication_rel pr"
+        "    join pg_catalog.pg_publication p on p.oid = pr.prpubid"
+        "    where pr.prrelid = $1::text::regclass"
+        " union all"
+        " select 'has the extended statistics ' || quote_ident(s.stxname)"
+        "    from pg_catalog.pg_statistic_ext s"
+        "    where s.stxrelid = $1::text::regclass";
+
+/**
+ * create the shadow table without any indexes. $1 is the table, $2 the shadow table.
+ */
+static const char * createSql =
+        "select format('create %stable %s (like %s including defaults including constraints"
+        "                   including storage including comments)%s%s',"
+        "        case when c.relpersistence = 'u' then 'unlogged ' else '' end,"
+        "        $2::text, $1::text,"
+        "        case when c.reloptions is not null then ' with (' || array_to_string(c.reloptions, ', ') || ')' else '' end,"
+        "        case when c.reltablespace <> 0 then ' tablespace ' || quote_ident(ts.spcname) else '' end)"
+        "    from pg_catalog.pg_class c"
+        "    left join pg_catalog.pg_tablespace ts on ts.oid = c.reltablespace"
+        "    where c.oid = $1::text::regclass";
+
+/**
+ * build the indexes of the shadow table using temporary names and rename them
+ * or turn them into constraints after the swap. $1 is the table, $2 the
+ * shadow table, $3 the prefix for the temporary index names and $4 the schema.
+ */
+static const char * indexSql =
+        "select format('create %sindex %I on %s %s',"
+        "            case when ix.indisunique then 'unique ' else '' end,"
+        "            ix.tmpname, $2::text,"
+        "            substr(ix.def, strpos(ix.def, ' USING ') + 1)),"
+        "        case when con.contype is not null then"
+        "            format('alter table %s add constraint %I %s using index %I%s',"
+        "                $1::text, con.conname,"
+        "                case when con.contype = 'p' then 'primary key' else 'unique' end,"
+        "                ix.tmpname,"
+        "                case when con.condeferrable then"
+        "                    ' deferrable initially ' || case when con.condeferred then 'deferred' else 'immediate' end"
+        "                else '' end)"
+        "        else"
+        "            format('alter index %I.%I rename to %I', $4::text, ix.tmpname, ix.relname)"
+        "        end"
+        "    from ("
+        "        select i.indexrelid, i.indisunique, ic.relname, pg_catalog.pg_get_indexdef(i.indexrelid) as def,"
+        "                $3::text || '_' || row_number() over (order by i.indexrelid) as tmpname"
+        "            from pg_catalog.pg_index i"
+        "            join pg_catalog.pg_class ic on ic.oid = i.indexrelid"
+        "            where i.indrelid = $1::text::regclass"
+        "    ) ix"
+        "    left join pg_catalog.pg_constraint con on con.conindid = ix.indexrelid"
+        "            and con.conrelid = $1::text::regclass and con.contype in ('p', 'u')"
+        "    order by ix.indexrelid";
+
+/**
+ * grants, owner and comment of the table applied to the shadow table. $1 is the
+ * table, $2 the shadow table.
+ */
+static const char * privilegesSql =
+        "select format('grant %s%s on %s to %s%s',"
+        "            a.privilege_type,"
+        "            case when a.attname is not null then ' (' || quote_ident(a.attname) || ')' else '' end,"
+        "            $2::text,"
+        "            case when a.grantee = 0 then 'public' else quote_ident(pg_catalog.pg_get_userbyid(a.grantee)) end,"
+        "            case when a.is_grantable then ' with grant option' else '' end)"
+        "    from ("
+        "        select null::name as attname, (pg_catalog.aclexplode(c.relacl)).*, c.relowner"
+        "            from pg_catalog.pg_class c"
+        "            where c.oid = $1::text::regclass"
+        "        union all"
+        "        select att.attname, (pg_catalog.aclexplode(att.attacl)).*, c.relowner"
+        "            from pg_catalog.pg_attribute att"
+        "            join pg_catalog.pg_class c on c.oid = att.attrelid"
+        "            where att.attrelid = $1::text::regclass and att.attacl is not null and not att.attisdropped"
+        "    ) a"
+        "    where a.grantee <> a.relowner"
+        " union all"
+        " select format('alter table %s owner to %I', $2::text, pg_catalog.pg_get_userbyid(c.relowner))"
+        "    from pg_catalog.pg_class c"
+        "    where c.oid = $1::text::regclass and pg_catalog.pg_get_userbyid(c.relowner) <> current_user"
+        " union all"
+        " select format('comment on table %s is %L', $2::text, d.description)"
+        "    from pg_catalog.pg_description d"
+        "    where d.objoid = $1::text::regclass and d.classoid = 'pg_catalog.pg_class'::regclass and d.objsubid = 0";
+
+/**
+ * redefine the views depending on the table, so they use the new table
+ * after the swap. $1 is the table.
+ */
+static const char * viewsSql =
+        "select distinct format('create or replace view %s%s as %s',"
+        "            v.oid::regclass::text,"
+        "            case when v.reloptions is not null then ' with (' || array_to_string(v.reloptions, ', ') || ')' else '' end,"
+        "            pg_catalog.pg_get_viewdef(v.oid))"
+        "    from pg_catalog.pg_depend d"
+        "    join pg_catalog.pg_rewrite r on r.oid = d.objid"
+        "    join pg_catalog.pg_class v on v.oid = r.ev_class"
+        "    where d.classid = 'pg_catalog.pg_rewrite'::regclass"
+        "        and d.refclassid = 'pg_catalog.pg_class'::regclass"
+        "        and d.refobjid = $1::text::regclass"
+        "        and v.relkind = 'v'";
+
+/**
+ * transfer the ownership of the sequences of serial columns. $1 is the table.
+ */
+static const char * sequencesSql =
+        "select format('alter sequence %s owned by %s.%I', s.oid::regclass::text, $1::text, a.attname)"
+        "    from pg_catalog.pg_depend d"
+        "    join pg_catalog.pg_class s on s.oid = d.objid and s.relkind = 'S'"
+        "    join pg_catalog.pg_attribute a on a.attrelid = d.refobjid and a.attnum = d.refobjsubid"
+        "    where d.classid = 'pg_catalog.pg_class'::regclass"
+        "        and d.refclassid = 'pg_catalog.pg_class'::regclass"
+        "        and d.refobjid = $1::text::regclass"
+        "        and d.deptype = 'a'";
+
+/**
+ * foreign keys of the table. $1 is the table.
+ */
+static const char * foreignKeysSql =
+        "select format('alter table %s add constraint %I %s', $1::text, c.conname, pg_catalog.pg_get_constraintdef(c.oid))"
+        "    from pg_catalog.pg_constraint c"
+        "    where c.conrelid = $1::text::regclass and c.contype = 'f'";
+
+
+TableSwap::TableSwap(Db::Transaction & _transaction, const std::string & _tableSchema,
+            const std::string & _tableName, const std::string & _shadowTableName)
+    :   logger(Poco::Logger::get("TableSwap")),
+        transaction(_transaction),
+        tableSchema(_tableSchema),
+        tableName(_tableName),
+        shadowTableName(_shadowTableName),
+        quotedTable(_transaction.quoteAndJoinIdent(_tableSchema, _tableName)),
+        quotedShadowTable(_transaction.quoteAndJoinIdent(_tableSchema, _shadowTableName))
+{
+}
+
+
+std::vector<std::string>
+TableSwap::generateStatements(const std::string & sql)
+{
+    // only the parameters used by the query may be passed as postgresql
+    // can not determinate the type of unused parameters
+    std::vector<QueryValue> params = { QueryValue(quotedTable) };
+    if (sql.find("$2") != std::string::npos) {
+        params.push_back(QueryValue(quotedShadowTable));
+    }
+
+    std::vector<std::string> statements;
+    auto res = transaction.execParams(sql, params);
+    for (int i=0; i<PQntuples(res.get()); i++) {
+        statements.push_back(PQgetvalue(res.get(), i, 0));
+    }
+    return statements;
+}
+
+
+void
+TableSwap::execStatements(const std::vector<std::string> & statements)
+{
+    for (const auto & statement : statements) {
+        poco_debug(logger, statement.c_str());
+        transaction.exec(statement);
+    }
+}
+
+
+void
+TableSwap::createShadowTable()
+{
+    auto problems = generateStatements(checkSql);
+    if (!problems.empty()) {
+        throw WorkerError("The table " + quotedTable + " can not be swapped as it "
+                    + StringUtils::join(problems, ", "));
+    }
+
+    poco_debug(logger, "creating shadow table " + quotedShadowTable + " of " + quotedTable);
+    execStatements(generateStatements(createSql));
+}
+
+
+void
+TableSwap::swap()
+{
+    // build the indexes in one go after all rows have been loaded
+    std::vector<QueryValue> indexParams = {
+                QueryValue(quotedTable),
+                QueryValue(quotedShadowTable),
+                QueryValue(shadowTableName),
+                QueryValue(tableSchema)
+    };
+    std::vector<std::string> finishIndexStatements;
+    {
+        auto indexRes = transaction.execParams(indexSql, indexParams);
+        for (int i=0; i<PQntuples(indexRes.get()); i++) {
+            std::string createIndexStatement = PQgetvalue(indexRes.get(), i, 0);
+            poco_debug(logger, createIndexStatement.c_str());
+            transaction.exec(createIndexStatement);
+            finishIndexStatements.push_back(PQgetvalue(indexRes.get(), i, 1));
+        }
+    }
+
+    execStatements(generateStatements(privilegesSql));
+
+    // the definitions refer to the table by its name, so they need to be
+    // fetched before the tables are renamed
+    auto viewStatements = generateStatements(viewsSql);
+    auto sequenceStatements = generateStatements(sequencesSql);
+    auto foreignKeyStatements = generateStatements(foreignKeysSql);
+
+    std::string previousTableName = shadowTableName + "_previous";
+    transaction.exec("alter table " + quotedTable + " rename to " + transaction.quoteIdent(previousTableName));
+    transaction.exec("alter table " + quotedShadowTable + " rename to " + transaction.quoteIdent(tableName));
+
+    execStatements(viewStatements);
+    execStatements(sequenceStatements);
+
+    // fails when there is still something depending on the previous table, which
+    // rolls back the whole swap
+    transaction.exec("drop table " + transaction.quoteAndJoinIdent(tableSchema, previousTableName));
+
+    execStatements(finishIndexStatements);
+    execStatements(foreignKeyStatements);
+
+    // the statistics of the previous table are gone
+    transaction.exec("analyze " + quotedTable);
+}
@@ -0,0 +1,88 @@
+#ifndef __batyr_tableswap_h__
+#define __batyr_tableswap_h__
+
+#include <Poco/Logger.h>
+
+#include <string>
+#include <vector>
+
+#include "server/db/transaction.h"
+
+
+namespace Batyr
+{
+
+    /**
+     * replaces the contents of a table by swapping it with a freshly
+     * loaded shadow table.
+     *
+     * The shadow table is created in the same schema and the same transaction
+     * as the pull, so postgresql may skip the WAL for it. Its indexes are
+     * built after it has been loaded instead of being updated row by row.
+     * The swap itself renames both tables and drops the previous one. Grants,
+     * the owner, sequences owned by the columns and dependent views are
+     * carried over to the new table. Dependent views are redefined using
+     * their own definition, so they keep their identity, grants and the
+     * objects depending on them.
+     *
+     * Tables with properties which can not be carried over - like foreign
+     * keys referencing them or triggers - are rejected by createShadowTable.
+     */
+    class TableSwap
+    {
+        private:
+            Poco::Logger & logger;
+            Db::Transaction & transaction;
+
+            std::string tableSchema;
+            std::string tableName;
+            std::string shadowTableName;
+
+            /** "schema"."table" */
+            std::string quotedTable;
+            std::string quotedShadowTable;
+
+            /**
+             * execute a query generating sql statements in its first column
+             * and return these statements. The parameters of the query are
+             * $1: the table, $2: the shadow table, $3: the name of the shadow table
+             * and $4: the schema.
+             */
+            std::vector<std::string> generateStatements(const std::string & sql);
+
+            void execStatements(const std::vector<std::string> & statements);
+
+        public:
+            TableSwap(Db::Transaction & _transaction, const std::string & _tableSchema,
+                        const std::string & _tableName, const std::string & _shadowTableName);
+
+            /** disable copying */
+            TableSwap(const TableSwap &) = delete;
+            TableSwap& operator=(const TableSwap &) = delete;
+
+            /**
+             * create the shadow table with the columns and check constraints
+             * of the table. Throws a WorkerError when the table can not be
+             * swapped.
+             */
+            void createShadowTable();
+
+            /**
+             * the schema-qualified and quoted name of the shadow table to write
+             * the features to.
+             */
+            const std::string & getQuotedShadowTable() const
+            {
+                return quotedShadowTable;
+            }
+
+            /**
+             * build the indexes of the loaded shadow table and replace the
+             * table with it
+             */
+            void swap();
+    };
+
+};
+
+#endif // __batyr_tableswap_h__
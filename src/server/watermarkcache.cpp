@@ -0,0 +1,40 @@
+#include "server/watermarkcache.h"
+
+using namespace Batyr;
+
+
+std::string
+WatermarkCache::get(const std::string & layerName, const std::string & filter)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = watermarks.find(Key(layerName, filter));
+    if (it == watermarks.end()) {
+        return "";
+    }
+    return it->second;
+}
+
+
+void
+WatermarkCache::set(const std::string & layerName, const std::string & filter, const std::string & watermark)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    watermarks[Key(layerName, filter)] = watermark;
+}
+
+
+void
+WatermarkCache::remove(const std::string & layerName)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (auto it = watermarks.begin(); it != watermarks.end();) {
+        if (it->first.first == layerName) {
+            it = watermarks.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef __batyr_watermarkcache_h__
+#define __batyr_watermarkcache_h__
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+
+namespace Batyr
+{
+
+    /**
+     * the highest values of the incremental_column of the features synced
+     * by the successful pulls of the layers. Shared by all workers.
+     *
+     * The watermarks are kept per layer and filter. A filtered pull only
+     * syncs the features matching its filter, so its watermark says nothing
+     * about the features of other filters.
+     */
+    class WatermarkCache
+    {
+        private:
+            /** layer name, filter */
+            typedef std::pair<std::string, std::string> Key;
+
+            std::map<Key, std::string> watermarks;
+            std::mutex mutex;
+
+        public:
+            /**
+             * the watermark of the last successful pull of the layer using the
+             * filter - formatted as a literal for an OGR attribute filter.
+             * Returns an empty string when there is none.
+             */
+            std::string get(const std::string & layerName, const std::string & filter);
+
+            void set(const std::string & layerName, const std::string & filter, const std::string & watermark);
+
+            /**
+             * forget the watermarks of a layer for all filters. Used when the
+             * target table gets modified by other means than a pull.
+             */
+            void remove(const std::string & layerName);
+
+            typedef std::shared_ptr<WatermarkCache> Ptr;
+    };
+
+};
+
+#endif // __batyr_watermarkcache_h__
@@ -6,13 +6,82 @@
 #include <thread>
 #include <vector>
 
+#include "common/allocationcounter.h"
 #include "common/config.h"
 #include "common/stringutils.h"
 #include "server/worker.h"
 #include "server/db/postgis.h"
+#include "server/db/copystream.h"
+#include "server/binarycopyencoder.h"
+#include "server/featureinserter.h"
+#include "server/columnplan.h"
+#include "server/featurepipeline.h"
+#include "server/tableswap.h"
+#include "server/sourcefingerprint.h"
+#include "server/watermarkcache.h"
+#include "server/stagingtable.h"
 
 using namespace Batyr;
 
+
+/**
+ * write the hex representation of binary data as accepted by the
+ * input functions of postgresql to hex. The storage of the string
+ * is reused.
+ */
+static void
+toHex(const unsigned char * data, size_t length, std::string & hex)
+{
+    static const char hexDigits[] = "0123456789ABCDEF";
+
+    hex.resize(length * 2);
+    for (size_t i=0; i<length; i++) {
+        hex[i * 2] = hexDigits[data[i] >> 4];
+        hex[i * 2 + 1] = hexDigits[data[i] & 0x0F];
+    }
+}
+
+/**
+ * record the time passed since stepStart as the duration of a step of
+ * the job and restart the measurement for the next step
+ */
+static void
+finishStep(Job::Ptr job, const std::string & step, std::chrono::steady_clock::time_point & stepStart)
+{
+    auto now = std::chrono::steady_clock::now();
+    job->addStepTiming(step, std::chrono::duration<double, std::milli>(now - stepStart).count());
+    stepStart = now;
+}
+
+
+/**
+ * set the attribute filter of the source layer. Throws a WorkerError
+ * when the filter is invalid.
+ */
+static void
+setAttributeFilter(OGRLayer * ogrLayer, const Layer & layer, const std::string & filterString)
+{
+    CPLErrorReset();
+    if (ogrLayer->SetAttributeFilter(filterString.c_str()) != OGRERR_NONE) {
+        std::stringstream msgstream;
+        msgstream   << "The given filter for layer \""
+                    << layer.name
+                    << "\" is invalid";
+        if (CPLGetLastErrorMsg()) {
+            msgstream   << ": " << CPLGetLastErrorMsg();
+        }
+        else {
+            msgstream   << ".";
+        }
+        msgstream   << " The applied filter was [ "
+                    << filterString
+                    << " ]";
+        CPLErrorReset();
+        throw WorkerError(msgstream.str());
+    }
+}
+
+
 struct OgrField
 {
     std::string name;
@@ -22,11 +91,18 @@ struct OgrField
 typedef std::map<std::string, OgrField> OgrFieldMap;
 
 
-Worker::Worker(Configuration::Ptr _configuration, std::shared_ptr<JobStorage> _jobs)
+Worker::Worker(Configuration::Ptr _configuration, std::shared_ptr<JobStorage> _jobs,
+            SourceFingerprintCache::Ptr _sourceFingerprints, WatermarkCache::Ptr _watermarks,
+            Db::ConnectionPool::Ptr _dbPool, Db::MetadataCache::Ptr _metadataCache,
+            Db::AsyncExecutor::Ptr _asyncExecutor)
     :   logger(Poco::Logger::get("Worker")),
         configuration(_configuration),
         jobs(_jobs),
-        db(_configuration)
+        sourceFingerprints(_sourceFingerprints),
+        watermarks(_watermarks),
+        dbPool(_dbPool),
+        metadataCache(_metadataCache),
+        asyncExecutor(_asyncExecutor)
 {
     poco_debug(logger, "Creating Worker");
 }
@@ -39,7 +115,7 @@ Worker::~Worker()
 
 
 void
-Worker::pull(Job::Ptr job)
+Worker::pull(Job::Ptr job, Db::Connection & db)
 {
     auto layer = configuration->getLayer(job->getLayerName());
     bool allow_feature_deletion = layer->allow_feature_deletion;
@@ -77,6 +153,18 @@ Worker::pull(Job::Ptr job)
         poco_information(logger, initialLogMsgStream.str().c_str());
     }
 
+    // skip the pull when the source did not change since the last successful pull
+    // using the same filter
+    std::string sourceFingerprint = SourceFingerprint::compute(*layer, filterString);
+    if (!sourceFingerprint.empty() && !job->getForce()
+                && sourceFingerprints->matches(layer->name, sourceFingerprint)) {
+        job->setSkipped(true);
+        job->setStatistics(0, 0, 0, 0);
+        job->setStatus(Job::Status::FINISHED);
+        poco_information(logger, "job " + job->getId() + " skipped as the source did not change since the last pull");
+        return;
+    }
+
     // open the dataset
 #if GDAL_VERSION_MAJOR > 1
     std::unique_ptr<GDALDataset> gdalDataset((GDALDataset*) GDALOpenEx(layer->source.c_str(), GDAL_OF_VECTOR | GDAL_OF_READONLY, NULL, NULL, NULL));
@@ -151,24 +239,7 @@ Worker::pull(Job::Ptr job)
         // partial syncs without losing the rest of the data
         allow_feature_deletion = false;
 
-        CPLErrorReset();
-        if (ogrLayer->SetAttributeFilter(filterString.c_str()) != OGRERR_NONE) {
-            std::stringstream msgstream;
-            msgstream   << "The given filter for layer \""
-                        << layer->name
-                        << "\" is invalid";
-            if (CPLGetLastErrorMsg()) {
-                msgstream   << ": " << CPLGetLastErrorMsg();
-            }
-            else {
-                msgstream   << ".";
-            }
-            msgstream   << " The applied filter was [ "
-                        << filterString
-                        << " ]";
-            CPLErrorReset();
-            throw WorkerError(msgstream.str());
-        }
+        setAttributeFilter(ogrLayer, *layer, filterString);
     }
 
     auto ogrFeatureDefn = ogrLayer->GetLayerDefn();
@@ -214,6 +285,24 @@ Worker::pull(Job::Ptr job)
         entry->type = ogrFieldDefn->GetType();
     }
 
+    // build a unique name for the temporary table
+    std::string tempTableName = "batyr_" + job->getId();
+
+    // stage into an unlogged table in a schema of its own instead of a temporary
+    // table. It is created before the transaction of the pull to be visible to all
+    // connections and gets dropped when the pull ends.
+    std::unique_ptr<SharedStagingTable> sharedStagingTable;
+    std::string stagingSchema;
+    if (!layer->staging_schema.empty() && !(layer->bulk_mode && (layer->bulk_delete_method == BULK_SWAP))) {
+        stagingSchema = layer->staging_schema;
+        sharedStagingTable.reset(new SharedStagingTable(db, stagingSchema, tempTableName));
+        sharedStagingTable->create(layer->target_table_schema, layer->target_table_name);
+    }
+
+    // the highest value of the incremental_column of the features read by
+    // this pull. Only taken over once the transaction has been committed.
+    std::string newWatermark;
+
     // perform the work in an transaction
     if (auto transaction = db.getTransaction()) {
         int numPulled = 0;
@@ -222,20 +311,68 @@ Worker::pull(Job::Ptr job)
         int numDeleted = 0;
         int numIgnored = 0;
 
+        auto stepStart = std::chrono::steady_clock::now();
+
         // set the postgresql date style
         transaction->exec("set DateStyle to SQL, YMD");
 
-        // build a unique name for the temporary table
-        std::string tempTableName = "batyr_" + job->getId();
+        // per layer tuning of the server settings. These need to be set before
+        // the temp table gets created.
+        applyServerSettings(job, *(transaction.get()), layer);
 
-        auto versionPostgis = Db::PostGis::getVersion(*(transaction.get()));
+        auto versionPostgis = metadataCache->getPostgisVersion(*(transaction.get()), db.getTarget());
 
-        // create a temp table to write the data to
-        transaction->createTempTable(layer->target_table_schema, layer->target_table_name, tempTableName);
+        // create a temp table to write the data to. When the target table gets swapped,
+        // the data is written to the shadow table replacing it instead.
+        std::unique_ptr<TableSwap> tableSwap;
+        std::string quotedStagingTable;
+        std::string quotedTargetTable = transaction->quoteAndJoinIdent(layer->target_table_schema, layer->target_table_name);
+        if (layer->bulk_mode && (layer->bulk_delete_method == BULK_SWAP)) {
+            if (db.getVersion() < 100000) {
+                throw WorkerError("bulk_delete_method \"swap\" requires postgresql 10 or later");
+            }
+            tableSwap.reset(new TableSwap(*(transaction.get()), layer->target_table_schema,
+                        layer->target_table_name, tempTableName));
+            tableSwap->createShadowTable();
+            quotedStagingTable = tableSwap->getQuotedShadowTable();
+        }
+        else if (sharedStagingTable) {
+            quotedStagingTable = sharedStagingTable->getQuotedTable();
+        }
+        else {
+            transaction->createTempTable(layer->target_table_schema, layer->target_table_name, tempTableName);
+            quotedStagingTable = transaction->quoteIdent(tempTableName);
+        }
 
         // fetch the column list from the target_table as the tempTable
         // does not have the constraints of the original table
-        auto tableFields = transaction->getTableFields(layer->target_table_schema, layer->target_table_name);
+        auto tableFields = metadataCache->getTableFields(*(transaction.get()), db.getTarget(),
+                    layer->target_table_schema, layer->target_table_name);
+
+        // only read the features which changed since the last successful pull using the
+        // same filter. A forced pull always reads all features and so is able to delete
+        // removed features.
+        std::string watermarkExpression;
+        bool watermarkIsString = false;
+        if (!layer->incremental_column.empty()) {
+            watermarkExpression = buildWatermarkExpression(*(transaction.get()), layer, tableFields, watermarkIsString);
+        }
+        if (!watermarkExpression.empty() && !job->getForce()) {
+            std::string watermark = watermarks->get(layer->name, filterString);
+            if (!watermark.empty()) {
+                // the features which have not been read are still part of the source
+                allow_feature_deletion = false;
+
+                std::string watermarkFilter = buildWatermarkFilter(layer, watermark);
+                std::string incrementalFilterString = watermarkFilter;
+                if (!filterString.empty()) {
+                    incrementalFilterString = "(" + filterString + ") and (" + watermarkFilter + ")";
+                }
+                setAttributeFilter(ogrLayer, *layer, incrementalFilterString);
+                poco_information(logger, "job " + job->getId() + " incrementally pulling features using filter \""
+                            + incrementalFilterString + "\"");
+            }
+        }
 
         // check if the requirements of the primary key are satisfied
         std::vector<std::string> primaryKeyColumns;
@@ -256,11 +393,26 @@ Worker::pull(Job::Ptr job)
                 geometryColumn = tableFieldPair.second.name;
                 insertColumns.push_back(tableFieldPair.second.name);
             }
-            if (ogrFields.find(tableFieldPair.second.name) != ogrFields.end() ||
+            if (tableFieldPair.second.name == layer->digest_column) {
+                // the digest is computed by batyr, even when the source has a field with the same name
+                insertColumns.push_back(tableFieldPair.second.name);
+            }
+            else if (ogrFields.find(tableFieldPair.second.name) != ogrFields.end() ||
                 ogrLayer->GetFIDColumn() == tableFieldPair.second.name) {
                 insertColumns.push_back(tableFieldPair.second.name);
             }
         }
+        if (!layer->digest_column.empty()) {
+            auto digestField = tableFields.find(layer->digest_column);
+            if (digestField == tableFields.end()) {
+                throw WorkerError("The configured digest column \"" + layer->digest_column + "\" does not exist in the table"
+                        " of layer \"" + job->getLayerName() + "\"");
+            }
+            if (digestField->second.isPrimaryKey) {
+                throw WorkerError("The digest column \"" + layer->digest_column + "\" of layer \"" + job->getLayerName() + "\""
+                        " must not be part of the primary key");
+            }
+        }
         // allow overriding the primarykey from the configfile if there are alternatives configured there
         if (!layer->primary_key_columns.empty()) {
             for(const auto primary_key_column : layer->primary_key_columns) {
@@ -290,166 +442,291 @@ Worker::pull(Job::Ptr job)
         int pgSrid = POSTGIS_NO_SRID_FOUND;
         int pgUndefinedSrid = Db::PostGis::getUndefinedSRIDValue(versionPostgis);
         if (!geometryColumn.empty()) {
-            pgSrid = Db::PostGis::getGeometryColumnSRID(*(transaction.get()),
+            pgSrid = metadataCache->getGeometryColumnSRID(*(transaction.get()), db.getTarget(),
                         layer->target_table_schema,
                         layer->target_table_name, geometryColumn);
             poco_debug(logger, "table " + layer->target_table_schema + "." + layer->target_table_name +
                         " column " + geometryColumn + " uses SRID " + std::to_string(pgSrid));
         }
 
-        // prepare an insert query into the temporary table
-        std::vector<std::string> insertQueryValues;
-        unsigned int idxColumn = 1;
-        for (const std::string &insertColumn : insertColumns) {
-            auto tableField = &tableFields[insertColumn];
-            std::stringstream colStream;
+        if (!geometryColumn.empty()) {
+            std::stringstream logStream;
+            logStream << "job " << job->getId() << " geometry_columns for " << geometryColumn;
 
-            if (tableField->pgTypeName != "geometry") {
-                auto ogrField = &ogrFields[insertColumn];
+            if (pgSrid == POSTGIS_NO_SRID_FOUND) {
+                logStream   << " contains no SRID information."
+                            << " Reprojection is impossible -> using the SRID of the geometries as they are read from the source.";
+            }
+            // all srids smaller than 1 are treated as undefined.
+            // see http://lists.osgeo.org/pipermail/postgis-devel/2011-October/015413.html
+            else if (pgSrid <= 0) {
+                logStream   << " returns SRID=" << pgSrid << " (undefined)."
+                            << " Reprojection is impossible -> assigning the SRID=" << pgUndefinedSrid << " (native undefined) to the new geometries";
+            }
+            else {
+                logStream   << " returns SRID=" << pgSrid << "."
+                            << " Reprojecting geometries with a SRS, assigning SRID=" << pgSrid << " to incomming geometries without SRS.";
+            }
+            poco_information(logger, logStream.str().c_str());
+        }
 
-                colStream   << "$" << idxColumn
-                            << "::" << getPostgresType(ogrField->type)
-                            << "::" << tableField->pgTypeName;
+        // build the sql expression to assign the SRID of the target column to a
+        // geometry value or to reproject it
+        auto buildGeometryExpression = [&](const std::string & geometryValue) -> std::string {
+            std::stringstream colStream;
+            if (pgSrid == POSTGIS_NO_SRID_FOUND) {
+                colStream   << geometryValue;
+            }
+            else if (pgSrid <= 0) {
+                colStream   << "st_setsrid(" << geometryValue << ", " << pgUndefinedSrid << ")";
             }
             else {
-                std::stringstream logStream;
-                logStream << "job " << job->getId() << " geometry_columns for " << insertColumn;
+                // in case the geometries do not have a SRS, assign the one of the table to them
+                colStream   << "(select "
+                            <<      "case when st_srid(foo.g) = " << pgUndefinedSrid << " then "
+                            <<          " st_setsrid(foo.g, " << pgSrid << ") "
+                            <<      "else "
+                            <<          " st_transform(foo.g, " << pgSrid << ") "
+                            <<      "end"
+                            << " from ( select " << geometryValue << " as g "
+                            << " ) foo)";
+            }
+            return colStream.str();
+        };
 
-                if (pgSrid == POSTGIS_NO_SRID_FOUND) {
-                    logStream   << " contains no SRID information."
-                                << " Reprojection is impossible -> using the SRID of the geometries as they are read from the source.";
+        // quoted once as the column list is part of most of the statements
+        std::string quotedInsertColumns = StringUtils::join(transaction->quoteIdent(insertColumns), ", ");
 
-                    colStream   <<  "$" << idxColumn << "::text::" << tableField->pgTypeName;
-                }
-                else {
-                    // all srids smaller than 1 are treated as undefined.
-                    // see http://lists.osgeo.org/pipermail/postgis-devel/2011-October/015413.html
-                    if (pgSrid <= 0) {
-                        logStream   << " returns SRID=" << pgSrid << " (undefined)."
-                                    << " Reprojection is impossible -> assigning the SRID=" << pgUndefinedSrid << " (native undefined) to the new geometries";
-
-                        colStream   << "st_setsrid($" << idxColumn << "::text::" << tableField->pgTypeName << ", "
-                                    << pgUndefinedSrid << ")";
-                    }
-                    else {
-                        logStream   << " returns SRID=" << pgSrid << "."
-                                    << " Reprojecting geometries with a SRS, assigning SRID=" << pgSrid << " to incomming geometries without SRS.";
-
-                        // in case the geometries do not have a SRS, assign the one of the table to them
-                        colStream   << "(select "
-                                    <<      "case when st_srid(foo.g) = " << pgUndefinedSrid << " then "
-                                    <<          " st_setsrid(foo.g, " << pgSrid << ") "
-                                    <<      "else "
-                                    <<          " st_transform(foo.g, " << pgSrid << ") "
-                                    <<      "end"
-                                    << " from ( select $" << idxColumn << "::text::" << tableField->pgTypeName << " as g "
-                                    << " ) foo)";
-                    }
-                }
-                poco_information(logger, logStream.str().c_str());
+        // resolve how the values of the insertColumns are read from the features once
+        // for the whole layer
+        ColumnPlan columnPlan;
+        for (const std::string &insertColumn : insertColumns) {
+            const auto & tableField = tableFields[insertColumn];
+            if (insertColumn == geometryColumn) {
+                columnPlan.addGeometry(tableField);
             }
+            else if (insertColumn == layer->digest_column) {
+                columnPlan.addDigest(tableField);
+            }
+            else if (ogrLayer->GetFIDColumn() == insertColumn) {
+                // handle special case where insertColumn is the fid
+                // with index = -1
+                columnPlan.addFid(tableField);
+            }
+            else {
+                const auto & ogrField = ogrFields[insertColumn];
+                columnPlan.addField(tableField, ogrField.index, ogrField.type);
+            }
+        }
 
-            insertQueryValues.push_back(colStream.str());
-            idxColumn++;
+        // build the sql expression to cast the raw value of a column to the
+        // type of the column in the target table
+        auto buildValueExpression = [&](const ColumnPlan::Column & column, const std::string & rawValue) -> std::string {
+            if (column.source == ColumnPlan::SOURCE_GEOMETRY) {
+                return buildGeometryExpression(rawValue + "::text::" + column.pgTypeName);
+            }
+            return rawValue + "::" + ColumnPlan::getPostgresType(column.fieldType) + "::" + column.pgTypeName;
+        };
+
+        // position of the geometry in the values of a feature
+        int geometryValueIdx = columnPlan.getGeometryIdx();
+
+        bool useCopy = (layer->staging_method == STAGING_COPY);
+        if (useCopy && layer->ignore_failures) {
+            // a failing row aborts the whole COPY, so single features
+            // can not be skipped
+            poco_warning(logger, "job " + job->getId() + ": layer \"" + layer->name + "\" ignores failures"
+                        " which is not possible using COPY. Falling back to staging with inserts.");
+            useCopy = false;
         }
-        std::stringstream insertQueryStream;
-        insertQueryStream   << "insert into " << transaction->quoteIdent(tempTableName) << " ("
-                            << StringUtils::join(transaction->quoteIdent(insertColumns), ", ")
-                            << ") "
-                            << "select "
-                            << StringUtils::join(insertQueryValues, ", ");
-        poco_debug(logger, insertQueryStream.str().c_str());
-        std::string insertStmtName = "batyr_insert" + job->getId();
-        auto resInsertStmt = transaction->prepare(insertStmtName, insertQueryStream.str(), insertColumns.size(), NULL);
+
+        // allocations of this thread while staging the features
+        uint64_t allocationsBeforeStaging = AllocationCounter::get();
+
+        finishStep(job, "prepare", stepStart);
 
         OGRFeature * ogrFeatureP = 0;
         // ensure that features get free'd by wraping them in a smart pointer
         std::unique_ptr<OGRFeature, decltype((OGRFeature::DestroyFeature))> ogrFeature(
                 NULL ,  OGRFeature::DestroyFeature);
 
-        while( (ogrFeatureP = ogrLayer->GetNextFeature()) != nullptr) {
-            ogrFeature.reset(ogrFeatureP);
-
-            std::vector<QueryValue> pgValues;
-
-            for (const std::string &insertColumn : insertColumns) {
-                auto tableField = &tableFields[insertColumn];
-
-                if (tableField->pgTypeName == "geometry") {
-
-                    QueryValue pgVal;
-                    auto ogrGeometry = ogrFeature->GetGeometryRef();
-                    if (ogrGeometry != nullptr) {
-                        // TODO: Maybe use the implementation from OGRPGLayer::GeometryToHex
-                        GByte * buffer;
-                        int bufferSize = ogrGeometry->WkbSize();
+        if (useCopy) {
+            // COPY the raw values into a second temporary table and cast them to the
+            // temporary table afterwards. This preserves the casting and reprojection
+            // behaviour of the inserts.
+            std::string copyTableName = tempTableName + "_copy";
+
+            // prefer the binary format which writes all values in the native representation
+            // of the target columns. This is only possible when all columns can be converted.
+            bool useBinaryCopy = BinaryCopyEncoder::supports(columnPlan);
+            if (!useBinaryCopy) {
+                poco_information(logger, "job " + job->getId() + ": not all columns of layer \"" + layer->name + "\""
+                            " can be written using the binary COPY format. Using the text format.");
+            }
 
-                        buffer = (GByte *) CPLMalloc(bufferSize);
-                        if (buffer == nullptr) {
-                            throw WorkerError("Unable to allocate memory to export geometry");
-                        }
-                        if (ogrGeometry->exportToWkb(wkbNDR, buffer) != OGRERR_NONE) {
-                            OGRFree(buffer);
-                            throw WorkerError("Could not export the geometry from feature #" + std::to_string(numPulled));
-                        }
-                        char * hexBuffer = CPLBinaryToHex(bufferSize, buffer);
-                        if (hexBuffer == nullptr) {
-                            OGRFree(buffer);
-                            throw WorkerError("Unable to allocate memory to convert geometry to hex");
-                        }
-                        OGRFree(buffer);
-                        pgVal.setIsNull(bufferSize == 0);
-                        if (!pgVal.isNull()) {
-                            pgVal.set(std::string(hexBuffer));
-                        }
-                        CPLFree(hexBuffer);
+            std::vector<std::string> copyColumnDefinitions;
+            std::vector<std::string> copyValueExpressions;
+            for (const auto &column : columnPlan.getColumns()) {
+                std::string qInsertColumn = transaction->quoteIdent(column.name);
+                if (useBinaryCopy) {
+                    // the values already have the type of the target column
+                    copyColumnDefinitions.push_back(qInsertColumn + " " + column.pgTypeName);
+                    if (column.source == ColumnPlan::SOURCE_GEOMETRY) {
+                        copyValueExpressions.push_back(buildGeometryExpression(qInsertColumn));
                     }
                     else {
-                        pgVal.setIsNull(true);
+                        copyValueExpressions.push_back(qInsertColumn);
                     }
-                    pgValues.push_back(std::move(pgVal));
                 }
                 else {
-                    if (ogrLayer->GetFIDColumn() == insertColumn) {
-                        // handle special case where insertColumn is the fid
-                        // with index = -1
-                        QueryValue pV = convertFidToString(ogrFeature.get());
-                        pgValues.push_back( std::move(pV) );
-                    } else {
-                        auto ogrField = &ogrFields[insertColumn];
-                        QueryValue pV = convertToString(ogrFeature.get(), ogrField->index, ogrField->type, tableField->pgTypeName);
-                        pgValues.push_back( std::move(pV) );
+                    if (column.source == ColumnPlan::SOURCE_GEOMETRY) {
+                        copyColumnDefinitions.push_back(qInsertColumn + " text");
                     }
+                    else {
+                        copyColumnDefinitions.push_back(qInsertColumn + " " + ColumnPlan::getPostgresType(column.fieldType));
+                    }
+                    copyValueExpressions.push_back(buildValueExpression(column, qInsertColumn));
                 }
             }
+            transaction->createTempTable(copyTableName, copyColumnDefinitions);
+
+            std::stringstream copyQueryStream;
+            copyQueryStream     << "copy " << transaction->quoteIdent(copyTableName) << " ("
+                                << quotedInsertColumns
+                                << ") from stdin";
+            if (useBinaryCopy) {
+                copyQueryStream << " with binary";
+            }
+            poco_debug(logger, copyQueryStream.str().c_str());
 
-            if (layer->ignore_failures) {
-                try {
-                    transaction->exec("savepoint insertfeature;");
-                    transaction->execPrepared(insertStmtName, pgValues);
-                    transaction->exec("release savepoint insertfeature;");
+            {
+                Db::CopyStream copyStream(*(transaction.get()), copyQueryStream.str(), layer->copy_flush_threshold);
+
+                if (useBinaryCopy) {
+                    BinaryCopyEncoder encoder(columnPlan);
+                    encoder.writeHeader(copyStream);
+                    while( (ogrFeatureP = ogrLayer->GetNextFeature()) != nullptr) {
+                        ogrFeature.reset(ogrFeatureP);
+
+                        encoder.writeFeature(ogrFeature.get(), copyStream);
+                        numPulled++;
+                    }
+                    encoder.writeTrailer(copyStream);
                 }
-                catch (Batyr::Db::DbError &e) {
-                    if (!e.isDataException()) {
-                        throw;
+                else {
+                    FeaturePipeline pipeline(ogrLayer, columnPlan, layer->convert_threads);
+                    ConvertedFeature feature;
+                    while (pipeline.next(feature)) {
+                        if ((geometryValueIdx >= 0) && (feature.wkbSize > 0)) {
+                            auto & geometryValue = feature.values[geometryValueIdx];
+                            geometryValue.setIsNull(false);
+                            toHex(feature.wkb.data(), feature.wkbSize, geometryValue.getMutable());
+                        }
+                        for (const auto &pgValue : feature.values) {
+                            copyStream.writeTextValue(pgValue);
+                        }
+                        copyStream.endTextRow();
+                        numPulled++;
                     }
-                    numIgnored++;
-                    transaction->exec("rollback to savepoint insertfeature;");
-
-                    std::stringstream ignoreMsgStream;
-                    ignoreMsgStream << "Ignoring feature: " << e.what();
-                    poco_warning(logger, ignoreMsgStream.str().c_str());
                 }
+                copyStream.finish();
             }
-            else {
-                transaction->execPrepared(insertStmtName, pgValues);
+
+            std::stringstream copyInsertStream;
+            copyInsertStream    << "insert into " << quotedStagingTable << " ("
+                                << quotedInsertColumns
+                                << ") "
+                                << "select "
+                                << StringUtils::join(copyValueExpressions, ", ")
+                                << " from " << transaction->quoteIdent(copyTableName);
+            poco_debug(logger, copyInsertStream.str().c_str());
+            transaction->exec(copyInsertStream.str());
+        }
+        else {
+            // the values of a single row of the insert query into the temporary table
+            auto buildInsertRow = [&](unsigned int firstParam) -> std::string {
+                std::vector<std::string> insertQueryValues;
+                unsigned int idxParam = firstParam;
+                for (const auto &column : columnPlan.getColumns()) {
+                    if (column.source == ColumnPlan::SOURCE_GEOMETRY) {
+                        // geometries are send as WKB using the binary format
+                        insertQueryValues.push_back(buildGeometryExpression("$" + std::to_string(idxParam) + "::bytea::geometry"));
+                    }
+                    else {
+                        insertQueryValues.push_back(buildValueExpression(column, "$" + std::to_string(idxParam)));
+                    }
+                    idxParam++;
+                }
+                return "(" + StringUtils::join(insertQueryValues, ", ") + ")";
+            };
+            std::stringstream insertQueryStream;
+            insertQueryStream   << "insert into " << quotedStagingTable << " ("
+                                << quotedInsertColumns
+                                << ") "
+                                << "values ";
+
+            FeatureInserter inserter(*transaction, insertQueryStream.str(), buildInsertRow, columnPlan.size(),
+                        "batyr_insert" + job->getId(), geometryValueIdx, layer->ignore_failures,
+                        layer->insert_batch_size);
+            FeaturePipeline pipeline(ogrLayer, columnPlan, layer->convert_threads);
+            ConvertedFeature feature;
+            while (pipeline.next(feature)) {
+                inserter.insert(feature.fid, feature.values, feature.wkb.data(), feature.wkbSize);
+                numPulled++;
             }
-            numPulled++;
+            inserter.finish();
+            numIgnored = inserter.getNumIgnored();
         }
         job->setStatistics(numPulled, numCreated, numUpdated, numDeleted, numIgnored);
 
+        if (AllocationCounter::isEnabled() && (numPulled > 0)) {
+            uint64_t numAllocations = AllocationCounter::get() - allocationsBeforeStaging;
+
+            std::stringstream allocMsgStream;
+            allocMsgStream  << "job " << job->getId() << ": staging " << numPulled << " features required "
+                            << numAllocations << " allocations ("
+                            << (static_cast<double>(numAllocations) / numPulled) << " per feature)";
+            poco_information(logger, allocMsgStream.str().c_str());
+        }
+        finishStep(job, "staging", stepStart);
+
+        if (!watermarkExpression.empty()) {
+            newWatermark = queryWatermark(*(transaction.get()), watermarkExpression, watermarkIsString, quotedStagingTable);
+        }
+
+        // the temp table has neither indexes nor statistics after being
+        // loaded. Without these the planner is not able to estimate the
+        // joins with the target table. Both are not needed when the whole
+        // table just gets copied in bulk mode.
+        if (!layer->bulk_mode) {
+            if (layer->staging_index) {
+                std::stringstream indexStmt;
+                indexStmt   << "create index on " << quotedStagingTable
+                            << " (" << StringUtils::join(transaction->quoteIdent(primaryKeyColumns), ", ") << ")";
+                transaction->exec(indexStmt.str());
+                finishStep(job, "index", stepStart);
+            }
+            if (layer->staging_analyze) {
+                transaction->exec("analyze " + quotedStagingTable);
+                finishStep(job, "analyze", stepStart);
+            }
+        }
+
+        // Replace the target table with the shadow table when swapping it in bulk mode.
+        if (tableSwap) {
+            std::stringstream countStmt;
+            countStmt << "select count(*) from " << quotedTargetTable;
+            auto countRes = transaction->exec(countStmt.str());
+            numDeleted = std::atoi(PQgetvalue(countRes.get(),0,0));
+            countRes.reset(NULL);
+
+            // the shadow table already contains all features
+            tableSwap->swap();
+            numCreated = numPulled - numIgnored;
+            finishStep(job, "swap", stepStart);
+        }
         // Update data using bulk mode if according option was set.
-        if (layer->bulk_mode) {
+        else if (layer->bulk_mode) {
 
             //
             // Delete or truncate all records from target table.
@@ -457,25 +734,26 @@ Worker::pull(Job::Ptr job)
             if (layer->bulk_delete_method == BULK_TRUNCATE) {
                 // Firstly count records in target table because PQcmdTuples() will not return a
                 // number of truncated records.
-                // Note: count function with primary key column should be faster than count(*) as
-                // it is an index in Postgres.
-                // Note: primaryKeyColumns[] was already checked for emptiness.
+                // Note: count(*) as configured primary key columns may contain null values which
+                // would not be counted by count(column).
                 std::stringstream countStmt;
-                countStmt << "select count(" << primaryKeyColumns[0] << ") from " << transaction->quoteAndJoinIdent(layer->target_table_schema, layer->target_table_name);
+                countStmt << "select count(*) from " << quotedTargetTable;
                 auto countRes = transaction->exec(countStmt.str());
                 numDeleted = std::atoi(PQgetvalue(countRes.get(),0,0));
                 countRes.reset(NULL);
                 // Than truncate table.
                 std::stringstream truncateStmt;
-                truncateStmt   << "truncate " << transaction->quoteAndJoinIdent(layer->target_table_schema, layer->target_table_name);
+                truncateStmt   << "truncate " << quotedTargetTable;
                 auto truncateRes = transaction->exec(truncateStmt.str());
                 truncateRes.reset(NULL);
+                finishStep(job, "truncate", stepStart);
             } else {
                 std::stringstream deleteStmt;
-                deleteStmt   << "delete from " << transaction->quoteAndJoinIdent(layer->target_table_schema, layer->target_table_name);
+                deleteStmt   << "delete from " << quotedTargetTable;
                 auto deleteRes = transaction->exec(deleteStmt.str());
                 numDeleted = std::atoi(PQcmdTuples(deleteRes.get()));
                 deleteRes.reset(NULL);
+                finishStep(job, "delete", stepStart);
             }
 
             //
@@ -485,130 +763,144 @@ Worker::pull(Job::Ptr job)
             // Note: temp table already has the same columns structure as the target table but we need
             // an order of columns to correctly insert data.
             // Note: insertColumns contains all columns even primary key and geometry columns.
-            insertStmt   << "insert into " << transaction->quoteAndJoinIdent(layer->target_table_schema, layer->target_table_name)
-                         << " ( " << StringUtils::join(transaction->quoteIdent(insertColumns), ", ") << ") "
-                         << " select " << StringUtils::join(transaction->quoteIdent(insertColumns), ", ") << " "
-                         << " from " << transaction->quoteIdent(tempTableName);
+            insertStmt   << "insert into " << quotedTargetTable
+                         << " ( " << quotedInsertColumns << ") "
+                         << " select " << quotedInsertColumns << " "
+                         << " from " << quotedStagingTable;
             auto insertRes = transaction->exec(insertStmt.str());
             numCreated = std::atoi(PQcmdTuples(insertRes.get()));
             insertRes.reset(NULL);
+            finishStep(job, "insert", stepStart);
 
         // Update data in a default way.
         } else {
+            SyncStatements syncStatements(*(transaction.get()), layer->target_table_schema, layer->target_table_name,
+                        stagingSchema, tempTableName, primaryKeyColumns, insertColumns, tableFields);
 
-            //
-            // update the existing/target table
-            //
-            std::stringstream updateStmt;
-            updateStmt          << "update " << transaction->quoteAndJoinIdent(layer->target_table_schema, layer->target_table_name) << " "
-                                << " set ";
-            for (size_t i=0; i<updateColumns.size(); i++) {
-                if (i != 0) {
-                    updateStmt << ", ";
-                }
-                updateStmt  << transaction->quoteIdent(updateColumns[i]) << " = "
-                            << transaction->quoteAndJoinIdent(tempTableName, updateColumns[i]) << " ";
-            }
-            updateStmt          << " from " << transaction->quoteIdent(tempTableName)
-                                << " where (";
-            for (size_t i=0; i<primaryKeyColumns.size(); i++) {
-                if (i != 0) {
-                    updateStmt << " and ";
-                }
-                updateStmt  << transaction->quoteAndJoinIdent(layer->target_table_name, primaryKeyColumns[i])
-                            << " is not distinct from "
-                            << transaction->quoteAndJoinIdent(tempTableName, primaryKeyColumns[i]);
-            }
-            updateStmt          << ") and (";
-
-            // add more WHERE conditions to only update rows which are actually different.
+            // conditions to only update rows which are actually different.
             // There is no purpose in performing updates when none of the colums changed. This will only
             // fire eventually exisiting triggers which would make the operation more expensive
             // ... and that should be avoided.
-            for (size_t i=0; i<updateColumns.size(); i++) {
-                if (i != 0) {
-                    updateStmt << " or ";
+            std::string changedCondition = syncStatements.changedCondition(updateColumns, layer->digest_column, versionPostgis);
+
+            if (db.getVersion() >= SERVER_MERGE_MIN_VERSION) {
+                //
+                // synchronize the target table using a single merge statement. This
+                // joins the target and the temp table only once instead of three times.
+                //
+                std::stringstream mergeStmt;
+                mergeStmt           << "with merged as ("
+                                    << "merge into " << quotedTargetTable
+                                    << " using " << syncStatements.getQuotedTempTable()
+                                    // configured primary key columns may be nullable, so the
+                                    // rows are matched using "is not distinct from" for them
+                                    << " on (" << syncStatements.keyCondition() << ")";
+                if (!updateColumns.empty()) {
+                    mergeStmt       << " when matched and (" << changedCondition << ") then update set ";
+                    for (size_t i=0; i<updateColumns.size(); i++) {
+                        if (i != 0) {
+                            mergeStmt << ", ";
+                        }
+                        mergeStmt   << syncStatements.columnAssignment(updateColumns[i]);
+                    }
+                }
+                mergeStmt           << " when not matched then insert ("
+                                    << quotedInsertColumns << ") values (";
+                for (size_t i=0; i<insertColumns.size(); i++) {
+                    if (i != 0) {
+                        mergeStmt << ", ";
+                    }
+                    mergeStmt   << syncStatements.quotedTempColumn(insertColumns[i]);
+                }
+                mergeStmt           << ")";
+                if (allow_feature_deletion) {
+                    mergeStmt       << " when not matched by source then delete";
+                }
+                mergeStmt           << " returning merge_action() as action";
+
+                // the values before the update are only accessible in the returning
+                // clause starting with postgresql 18
+                bool reportKeptBytes = db.getVersion() >= SERVER_RETURNING_OLD_MIN_VERSION;
+                if (reportKeptBytes) {
+                    mergeStmt       << ", case when merge_action() = 'UPDATE' then "
+                                    << syncStatements.unchangedBytes(updateColumns, "old")
+                                    << " else 0 end as kept_bytes"
+                                    << ") select action, count(*), coalesce(sum(kept_bytes), 0) from merged group by action";
+                }
+                else {
+                    mergeStmt       << ") select action, count(*), 0 from merged group by action";
                 }
 
-                auto tableField = &tableFields[updateColumns[i]];
-
-                if (tableField->pgTypeName == "geometry") {
-                    std::string quotedTargetGeom =  transaction->quoteAndJoinIdent(layer->target_table_name, updateColumns[i]);
-                    std::string quotedTempGeom = transaction->quoteAndJoinIdent(tempTableName, updateColumns[i]);
-
-                    // update geometries always when the srid differs or when they are collections.
-                    // MEMO: geometries with different SRIDs can not be compared with the "=" operator
-                    // MEMO: collections can not be compared with st_equals
-                    updateStmt  << "("
-                                <<      "case when "
-                                <<          "(st_srid(" << quotedTargetGeom << ") != st_srid(" << quotedTempGeom << ")) ";
+                if (layer->explain_sync) {
+                    explainSync(job, *(transaction.get()), syncStatements, layer->explain_sync_analyze, mergeStmt.str(),
+                                allow_feature_deletion, geometryColumn, updateColumns, layer->digest_column, versionPostgis);
+                    finishStep(job, "explain", stepStart);
+                }
 
-                    if (std::get<0>(versionPostgis) >= 2) {
-                            // st_iscollection is only supported starting with postgis 2.0
-                            updateStmt  << " or st_iscollection(" << quotedTargetGeom << ") "
-                                        << " or st_iscollection(" << quotedTempGeom << ") ";
+                auto mergeRes = transaction->exec(mergeStmt.str());
+                for (int i=0; i<PQntuples(mergeRes.get()); i++) {
+                    std::string action = PQgetvalue(mergeRes.get(), i, 0);
+                    int count = std::atoi(PQgetvalue(mergeRes.get(), i, 1));
+                    if (action == "INSERT") {
+                        numCreated = count;
                     }
-                    else {
-                            updateStmt  << " or ("
-                                        <<   "st_geometrytype(" << quotedTargetGeom << ") = 'ST_GeometryCollection'"
-                                        <<   " or st_geometrytype(" << quotedTargetGeom << ") like 'ST_Multi%'"
-                                        << ") "
-                                        << " or ("
-                                        <<   "st_geometrytype(" << quotedTempGeom << ") = 'ST_GeometryCollection'"
-                                        <<   " or st_geometrytype(" << quotedTempGeom << ") like 'ST_Multi%'"
-                                        << ") ";
+                    else if (action == "UPDATE") {
+                        numUpdated = count;
+                        if (reportKeptBytes) {
+                            job->setNumBytesKept(std::atoll(PQgetvalue(mergeRes.get(), i, 2)));
+                        }
+                    }
+                    else if (action == "DELETE") {
+                        numDeleted = count;
                     }
-
-                    updateStmt  <<  "then "
-                                // compare using the binary representation as ST_Equals can not be used in this case
-                                <<      quotedTargetGeom << "::bytea " << " is distinct from " << quotedTempGeom << "::bytea "
-                                <<  " else "
-                                // compare using st_equals
-                                <<      "not st_equals("  << quotedTargetGeom << ", " << quotedTempGeom << ")"
-                                <<  " end "
-                                << ")";
-                }
-                else {
-                    updateStmt  << "(" << transaction->quoteAndJoinIdent(layer->target_table_name, updateColumns[i])
-                                << " is distinct from "
-                                << transaction->quoteAndJoinIdent(tempTableName, updateColumns[i]) << ")";
                 }
+                mergeRes.reset(NULL); // immediately dispose the result
+                finishStep(job, "merge", stepStart);
             }
-            updateStmt          << ")";
-            auto updateRes = transaction->exec(updateStmt.str());
-            numUpdated = std::atoi(PQcmdTuples(updateRes.get()));
-            updateRes.reset(NULL); // immediately dispose the result
-
-            //
-            // insert missing rows in the exisiting/target table
-            //
-            std::stringstream insertMissingStmt;
-            insertMissingStmt   << "insert into " << transaction->quoteAndJoinIdent(layer->target_table_schema, layer->target_table_name)
-                                << " ( " << StringUtils::join(transaction->quoteIdent(insertColumns), ", ") << ") "
-                                << " select " << StringUtils::join(transaction->quoteIdent(insertColumns), ", ") << " "
-                                << " from " << transaction->quoteIdent(tempTableName)
-                                << " where (" << StringUtils::join(transaction->quoteIdent(primaryKeyColumns), ", ") << ") not in ("
-                                << " select " << StringUtils::join(transaction->quoteIdent(primaryKeyColumns), ",") << " "
-                                << "       from " << transaction->quoteAndJoinIdent(layer->target_table_schema, layer->target_table_name)
-                                << ")";
-            auto insertMissingRes = transaction->exec(insertMissingStmt.str());
-            numCreated = std::atoi(PQcmdTuples(insertMissingRes.get()));
-            insertMissingRes.reset(NULL); // immediately dispose the result
+            else {
+                if (layer->explain_sync) {
+                    explainSync(job, *(transaction.get()), syncStatements, layer->explain_sync_analyze, "",
+                                allow_feature_deletion, geometryColumn, updateColumns, layer->digest_column, versionPostgis);
+                    finishStep(job, "explain", stepStart);
+                }
 
-            //
-            // delete deprecated rows from the exisiting/target table
-            //
-            if (allow_feature_deletion) {
-                std::stringstream deleteRemovedStmt;
-                auto quotedPrimaryKeyColumnsStr = StringUtils::join(transaction->quoteIdent(primaryKeyColumns), ", ");
-                deleteRemovedStmt   << "delete from " << transaction->quoteAndJoinIdent(layer->target_table_schema, layer->target_table_name)
-                                    << " where (" << quotedPrimaryKeyColumnsStr << ") not in ("
-                                    << " select " << quotedPrimaryKeyColumnsStr << " "
-                                    << "       from " << transaction->quoteIdent(tempTableName)
-                                    << ")";
-                auto deleteRemovedRes = transaction->exec(deleteRemovedStmt.str());
-                numDeleted = std::atoi(PQcmdTuples(deleteRemovedRes.get()));
-                deleteRemovedRes.reset(NULL); // immediately dispose the result
+                //
+                // update the existing/target table
+                //
+                std::stringstream updateStmt;
+                updateStmt          << "update " << quotedTargetTable << " "
+                                    << " set ";
+                for (size_t i=0; i<updateColumns.size(); i++) {
+                    if (i != 0) {
+                        updateStmt << ", ";
+                    }
+                    updateStmt  << syncStatements.columnAssignment(updateColumns[i]) << " ";
+                }
+                updateStmt          << " from " << syncStatements.getQuotedTempTable()
+                                    << " where (" << syncStatements.keyCondition() << ")"
+                                    << " and (" << changedCondition << ")";
+                auto updateRes = transaction->exec(updateStmt.str());
+                numUpdated = std::atoi(PQcmdTuples(updateRes.get()));
+                updateRes.reset(NULL); // immediately dispose the result
+                finishStep(job, "update", stepStart);
+
+                //
+                // insert missing rows in the exisiting/target table
+                //
+                auto insertMissingRes = transaction->exec(syncStatements.insertMissing());
+                numCreated = std::atoi(PQcmdTuples(insertMissingRes.get()));
+                insertMissingRes.reset(NULL); // immediately dispose the result
+                finishStep(job, "insert missing", stepStart);
+
+                //
+                // delete deprecated rows from the exisiting/target table
+                //
+                if (allow_feature_deletion) {
+                    auto deleteRemovedRes = transaction->exec(syncStatements.deleteRemoved());
+                    numDeleted = std::atoi(PQcmdTuples(deleteRemovedRes.get()));
+                    deleteRemovedRes.reset(NULL); // immediately dispose the result
+                    finishStep(job, "delete removed", stepStart);
+                }
             }
         }
 
@@ -633,11 +925,215 @@ Worker::pull(Job::Ptr job)
         job->setMessage(msg);
     }
 
+    // remember the source only once the transaction has been committed. Filtered
+    // pulls do not update all features, so they can not be used to skip later pulls
+    // using a different filter - this is ensured by the filter being part of the
+    // fingerprint.
+    if (!sourceFingerprint.empty() && (job->getStatus() == Job::Status::FINISHED)) {
+        sourceFingerprints->set(layer->name, sourceFingerprint);
+    }
+
+    // a pull which did not read any feature keeps the previous watermark
+    if (!newWatermark.empty() && (job->getStatus() == Job::Status::FINISHED)) {
+        watermarks->set(layer->name, filterString, newWatermark);
+    }
+}
+
+
+std::string
+Worker::buildWatermarkExpression(Db::Transaction & transaction, Layer::Ptr layer, const Db::FieldMap & tableFields,
+            bool & isString)
+{
+    auto tableField = tableFields.find(layer->incremental_column);
+    if (tableField == tableFields.end()) {
+        throw WorkerError("The incremental_column \"" + layer->incremental_column + "\" does not exist in the table"
+                    " of layer \"" + layer->name + "\"");
+    }
+
+    // format the highest value like OGR expects it in attribute filters
+    std::string quotedColumn = transaction.quoteIdent(layer->incremental_column);
+    const std::string & pgTypeName = tableField->second.pgTypeName;
+    isString = true;
+    if ((pgTypeName == "int2") || (pgTypeName == "int4") || (pgTypeName == "int8")
+                || (pgTypeName == "float4") || (pgTypeName == "float8") || (pgTypeName == "numeric")) {
+        isString = false;
+        return "max(" + quotedColumn + ")::text";
+    }
+    else if (pgTypeName == "date") {
+        // dates and timestamps use the ISO format. Drivers which pass the filter
+        // on to a database - like SQLite and GeoPackage - compare the values as
+        // strings in this format.
+        return "to_char(max(" + quotedColumn + "), 'YYYY-MM-DD')";
+    }
+    else if (pgTypeName == "timestamp") {
+        // fractions of seconds are cut off. This only causes some features to be read again.
+        return "to_char(max(" + quotedColumn + "), 'YYYY-MM-DD HH24:MI:SS')";
+    }
+    else if (pgTypeName == "timestamptz") {
+        // independent of the timezone setting of the session. Sources are
+        // expected to store timestamps with timezone in UTC.
+        return "to_char(max(" + quotedColumn + ") at time zone 'UTC', 'YYYY-MM-DD HH24:MI:SS')";
+    }
+    else if ((pgTypeName == "text") || (pgTypeName == "varchar") || (pgTypeName == "bpchar")) {
+        return "max(" + quotedColumn + ")";
+    }
+    throw WorkerError("The incremental_column \"" + layer->incremental_column + "\" of layer \""
+                + layer->name + "\" has the unsupported type " + pgTypeName);
+}
+
+
+std::string
+Worker::queryWatermark(Db::Transaction & transaction, const std::string & expression, bool isString,
+            const std::string & quotedTable)
+{
+    auto res = transaction.exec("select " + expression + " from " + quotedTable);
+    if (PQgetisnull(res.get(), 0, 0)) {
+        // no features
+        return "";
+    }
+    std::string watermark = PQgetvalue(res.get(), 0, 0);
+    if (isString) {
+        StringUtils::replaceAll(watermark, "'", "''");
+        watermark = "'" + watermark + "'";
+    }
+    return watermark;
+}
+
+
+std::string
+Worker::buildWatermarkFilter(Layer::Ptr layer, const std::string & watermark)
+{
+    std::string ogrColumn = layer->incremental_column;
+    StringUtils::replaceAll(ogrColumn, "\"", "\"\"");
+
+    // features with the same value as the watermark are read again as there
+    // may be features with this value which have been added after the last pull
+    return "\"" + ogrColumn + "\" >= " + watermark;
 }
 
 
 void
-Worker::removeByAttributes(Job::Ptr job)
+Worker::applyServerSettings(Job::Ptr job, Db::Transaction & transaction, Layer::Ptr layer)
+{
+    std::vector<std::pair<std::string, std::string>> settings;
+    settings.push_back(std::make_pair("work_mem", layer->work_mem));
+    settings.push_back(std::make_pair("temp_tablespaces", layer->temp_tablespaces));
+    settings.push_back(std::make_pair("synchronous_commit", layer->synchronous_commit));
+
+    for (const auto & setting : settings) {
+        if (!setting.second.empty()) {
+            // set_config with is_local=true is the same as "set local", but
+            // allows passing the value as a parameter
+            std::vector<QueryValue> params = { QueryValue(setting.first), QueryValue(setting.second) };
+            transaction.execParams("select set_config($1::text, $2::text, true)", params);
+        }
+    }
+
+    if (!layer->temp_buffers.empty()) {
+        // temp_buffers can not be changed anymore after the session accessed a
+        // temporary table, which happens with persistent connections. This
+        // is not worth failing the job for.
+        std::vector<QueryValue> params = { QueryValue(layer->temp_buffers) };
+
+        const std::string savepointName = "batyr_temp_buffers";
+        transaction.savepoint(savepointName);
+        try {
+            transaction.execParams("select set_config('temp_buffers', $1::text, true)", params);
+        }
+        catch (Db::DbError &e) {
+            transaction.rollbackToSavepoint(savepointName);
+            poco_warning(logger, "job " + job->getId() + ": could not set temp_buffers: " + std::string(e.what()));
+        }
+        transaction.releaseSavepoint(savepointName);
+    }
+}
+
+
+void
+Worker::explainSync(Job::Ptr job, Db::Transaction & transaction, const SyncStatements & syncStatements,
+            bool analyze, const std::string & mergeStatement,
+            bool allowFeatureDeletion, const std::string & geometryColumn,
+            const std::vector<std::string> & updateColumns, const std::string & digestColumn,
+            const Db::PostGis::VersionTuple & versionPostgis)
+{
+    std::vector<std::pair<std::string, std::string>> statements;
+    if (!mergeStatement.empty()) {
+        statements.push_back(std::make_pair("merge", mergeStatement));
+        poco_information(logger, "job " + job->getId() + ": the target table is synchronized using the merge"
+                    " statement. The plans of the insert and delete statements are only logged for comparison.");
+    }
+    statements.push_back(std::make_pair("insert missing (not in)", syncStatements.insertMissingNotIn()));
+    statements.push_back(std::make_pair("insert missing (anti-join)", syncStatements.insertMissing()));
+    if (allowFeatureDeletion) {
+        statements.push_back(std::make_pair("delete removed (not in)", syncStatements.deleteRemovedNotIn()));
+        statements.push_back(std::make_pair("delete removed (anti-join)", syncStatements.deleteRemoved()));
+    }
+
+    // with analyze the statements are actually executed to get the timings,
+    // but every change gets rolled back again
+    const std::string savepointName = "batyr_explain";
+    for (const auto & statement : statements) {
+        if (analyze) {
+            transaction.savepoint(savepointName);
+        }
+        auto explainRes = transaction.exec((analyze ? "explain (analyze, buffers) " : "explain ") + statement.second);
+
+        std::stringstream planStream;
+        planStream  << "job " << job->getId() << ": query plan of " << statement.first << ":";
+        for (int i=0; i<PQntuples(explainRes.get()); i++) {
+            planStream << "\n" << PQgetvalue(explainRes.get(), i, 0);
+        }
+        explainRes.reset(NULL);
+        poco_information(logger, planStream.str().c_str());
+
+        if (analyze) {
+            transaction.rollbackToSavepoint(savepointName);
+            transaction.releaseSavepoint(savepointName);
+        }
+    }
+    // how the geometries get compared when updating the target table. Every
+    // row counted as "st_equals" requires a call to GEOS.
+    if (!geometryColumn.empty()) {
+        auto statsRes = transaction.exec(syncStatements.geometryComparisonStats(geometryColumn, versionPostgis));
+
+        std::stringstream statsStream;
+        statsStream << "job " << job->getId() << ": comparisons of the geometry column " << geometryColumn << ":";
+        for (int i=0; i<PQntuples(statsRes.get()); i++) {
+            statsStream << " " << PQgetvalue(statsRes.get(), i, 0) << "=" << PQgetvalue(statsRes.get(), i, 1);
+        }
+        poco_information(logger, statsStream.str().c_str());
+    }
+
+    // the size of the values the update keeps instead of writing them again
+    if (!updateColumns.empty()) {
+        auto keptRes = transaction.exec(syncStatements.unchangedBytesStats(updateColumns, digestColumn, versionPostgis));
+
+        std::stringstream keptStream;
+        keptStream  << "job " << job->getId() << ": updating " << PQgetvalue(keptRes.get(), 0, 0)
+                    << " rows keeps " << PQgetvalue(keptRes.get(), 0, 1) << " bytes of unchanged values";
+        poco_information(logger, keptStream.str().c_str());
+    }
+}
+
+
+/**
+ * set the result of a finished remove-by-attributes job
+ */
+static void
+finishRemoveByAttributes(Poco::Logger & logger, Job::Ptr job, int numDeleted)
+{
+    job->setStatistics(0, 0, 0, numDeleted);
+    job->setStatus(Job::Status::FINISHED);
+
+    std::stringstream finalLogMsgStream;
+    finalLogMsgStream   << "job " << job->getId() << " finished. Stats: "
+                        << "deleted=" << numDeleted;
+    poco_information(logger, finalLogMsgStream.str().c_str());
+}
+
+
+void
+Worker::removeByAttributes(Job::Ptr job, Db::PooledConnection::Ptr & db)
 {
     {
         std::stringstream initialLogMsgStream;
@@ -648,6 +1144,10 @@ Worker::removeByAttributes(Job::Ptr job)
 
     auto layer = configuration->getLayer(job->getLayerName());
 
+    // the target table will not match the source anymore
+    sourceFingerprints->remove(layer->name);
+    watermarks->remove(layer->name);
+
     if (!layer->allow_feature_deletion) {
         std::string msg = "Layer \"" + job->getLayerName() + "\" does not allow deletion of features.";
         poco_warning(logger, msg.c_str());
@@ -657,68 +1157,94 @@ Worker::removeByAttributes(Job::Ptr job)
     }
 
 
+    // the delete statement is built from the cached columns of the target
+    // table. Only when they are not cached, they are looked up in a
+    // transaction of its own.
+    Db::FieldMap tableFields;
+    if (!metadataCache->findTableFields((*db)->getTarget(), layer->target_table_schema, layer->target_table_name, tableFields)) {
+        auto transaction = (*db)->getTransaction();
+        if (!transaction) {
+            std::string msg("Could not start a database transaction");
+            poco_error(logger, msg.c_str());
+            job->setMessage(msg);
+            job->setStatus(Job::Status::FAILED);
+            return;
+        }
+        tableFields = metadataCache->getTableFields(*(transaction.get()), (*db)->getTarget(),
+                    layer->target_table_schema, layer->target_table_name);
+    }
 
-    // perform the work in an transaction
-    if (auto transaction = db.getTransaction()) {
-
-        // set the postgresql date style
-        transaction->exec("set DateStyle to SQL, YMD");
-
-        // fetch the column list from the target_table as the tempTable
-        // does not have the constraints of the original table
-        auto tableFields = transaction->getTableFields(layer->target_table_schema, layer->target_table_name);
-
-        std::stringstream deleteStmt;
-        deleteStmt  << "delete from " << transaction->quoteAndJoinIdent(layer->target_table_schema, layer->target_table_name)
-                    << " where ";
+    std::stringstream deleteStmt;
+    deleteStmt  << "delete from " << Db::Transaction::quoteAndJoinIdent(layer->target_table_schema, layer->target_table_name)
+                << " where ";
 
-        int numDeleted = 0;
-        std::vector<Job::AttributeValue> attrValues;
-        for(const auto & attributeSet: job->getAttributeSets()) {
-            if (attributeSet.size() > 0) {
-                int i = 0;
-                if (!attrValues.empty()) {
-                    deleteStmt << " or ";
+    std::vector<Job::AttributeValue> attrValues;
+    for(const auto & attributeSet: job->getAttributeSets()) {
+        if (attributeSet.size() > 0) {
+            int i = 0;
+            if (!attrValues.empty()) {
+                deleteStmt << " or ";
+            }
+            deleteStmt << " ( ";
+            for(const auto & attributePair: attributeSet) {
+                auto tableFieldIt = tableFields.find(attributePair.first);
+                if (tableFieldIt == tableFields.end()) {
+                    throw WorkerError("Layer \"" + job->getLayerName() + "\" has no field \""
+                                    + attributePair.first + "\"");
                 }
-                deleteStmt << " ( ";
-                for(const auto & attributePair: attributeSet) {
-                    auto tableFieldIt = tableFields.find(attributePair.first);
-                    if (tableFieldIt == tableFields.end()) {
-                        throw WorkerError("Layer \"" + job->getLayerName() + "\" has no field \""
-                                        + attributePair.first + "\"");
-                    }
-                    if (i > 0) {
-                        deleteStmt << " and ";
-                    }
-                    attrValues.push_back(attributePair.second);
-                    deleteStmt  << transaction->quoteAndJoinIdent(layer->target_table_name, attributePair.first)
-                                << " is not distinct from $" << attrValues.size() << "::" << tableFieldIt->second.pgTypeName;
-                    ++i;
+                if (i > 0) {
+                    deleteStmt << " and ";
                 }
-                deleteStmt << " ) ";
+                attrValues.push_back(attributePair.second);
+                deleteStmt  << Db::Transaction::quoteAndJoinIdent(layer->target_table_name, attributePair.first)
+                            << " is not distinct from $" << attrValues.size() << "::" << tableFieldIt->second.pgTypeName;
+                ++i;
             }
+            deleteStmt << " ) ";
         }
+    }
 
-        if (!attrValues.empty()) {
-            poco_debug(logger, deleteStmt.str().c_str());
-
-            auto deleteRes = transaction->execParams(deleteStmt.str(), attrValues);
-            numDeleted = std::atoi(PQcmdTuples(deleteRes.get()));
-        }
-        else {
-            std::stringstream logMsgStream;
-            logMsgStream   << "job " << job->getId() << ": no attributes to remove features given. skipping";
-            poco_information(logger, logMsgStream.str().c_str());
-        }
+    if (attrValues.empty()) {
+        std::stringstream logMsgStream;
+        logMsgStream   << "job " << job->getId() << ": no attributes to remove features given. skipping";
+        poco_information(logger, logMsgStream.str().c_str());
+        finishRemoveByAttributes(logger, job, 0);
+        return;
+    }
 
-        job->setStatus(Job::Status::FINISHED);
-        job->setStatistics(0, 0, 0, numDeleted);
+    poco_debug(logger, deleteStmt.str().c_str());
+
+    // set the postgresql date style in the same transaction as the delete
+    const char * dateStyleStmt = "set DateStyle to SQL, YMD";
+
+    if (asyncExecutor) {
+        // the delete is executed by the executor, so the worker can go on
+        // with the next job. The job is finished by the callback, which
+        // may run after this worker has been destroyed.
+        Poco::Logger * workerLogger = &logger;
+        Db::MetadataCache::Ptr cache = metadataCache;
+        asyncExecutor->submit(std::move(db), {{dateStyleStmt, {}}, {deleteStmt.str(), attrValues}},
+                    [workerLogger, cache, layer, job](const Db::AsyncExecutor::Result & result) {
+            if (result.error) {
+                poco_error(*workerLogger, result.error->what());
+                if (result.error->isSchemaChange()) {
+                    cache->invalidateTable(layer->target_table_schema, layer->target_table_name);
+                }
+                job->setMessage(result.error->what());
+                job->setStatus(Job::Status::FAILED);
+                return;
+            }
+            finishRemoveByAttributes(*workerLogger, job, result.numAffectedRows.back());
+        });
+        return;
+    }
 
-        std::stringstream finalLogMsgStream;
-        finalLogMsgStream   << "job " << job->getId() << " finished. Stats: "
-                            << "deleted=" << numDeleted;
-        poco_information(logger, finalLogMsgStream.str().c_str());
+    // perform the work in an transaction
+    if (auto transaction = (*db)->getTransaction()) {
+        transaction->exec(dateStyleStmt);
 
+        auto deleteRes = transaction->execParams(deleteStmt.str(), attrValues);
+        finishRemoveByAttributes(logger, job, std::atoi(PQcmdTuples(deleteRes.get())));
     }
     else {
         std::string msg("Could not start a database transaction");
@@ -728,6 +1254,25 @@ Worker::removeByAttributes(Job::Ptr job)
     }
 }
 
+void
+Worker::invalidateMetadata(Job::Ptr job, const Db::DbError & error)
+{
+    if (!error.isSchemaChange()) {
+        return;
+    }
+
+    Layer::Ptr layer;
+    try {
+        layer = configuration->getLayer(job->getLayerName());
+    }
+    catch (ConfigurationError &) {
+        return;
+    }
+    poco_information(logger, "Removing the cached metadata of table " + layer->target_table_schema
+                + "." + layer->target_table_name + " as its structure may have been changed");
+    metadataCache->invalidateTable(layer->target_table_schema, layer->target_table_name);
+}
+
 
 void
 Worker::run()
@@ -735,44 +1280,43 @@ Worker::run()
     while (true) {
         Job::Ptr job;
         try {
-            jobs->popNoWait(job);
+            // wait for a new job to arrive
+            // getting no job means the queue recieved a quit command, so the worker
+            // can be shut down
+            jobs->popWait(job);
             if (!job) {
-                // shut down the db connection if this behaviour is configured and
-                if (!configuration->usePersistentDbConnections()) {
-                    poco_debug(logger, "No jobs queued - closing db connection");
-                    db.close();
-                }
-
-                // wait for a new job to arrive
-                // getting still no job means the queue recieved a quit command, so the worker
-                // can be shut down
-                jobs->popWait(job);
-                if (!job) {
-                    break;
-                }
+                break;
             }
             poco_debug(logger, "Got job from queue");
             job->setStatus(Job::Status::IN_PROCESS);
 
-            // check if we got a working database connection
-            // or block until we got one
+            // borrow a working database connection from the pool or block
+            // until we got one. It gets returned when the job is done.
+            Db::PooledConnection::Ptr db;
             size_t reconnectAttempts = 0;
-            while(!db.reconnect(true)) {
-                if (reconnectAttempts == 0) {
-                    // set job message to inform clients we are waiting here
-                    job->setMessage("Waiting to aquire a database connection");
+            while (!db) {
+                try {
+                    db = dbPool->acquire();
+                }
+                catch (Batyr::Db::DbError &e) {
+                    if (reconnectAttempts == 0) {
+                        poco_warning(logger, e.what());
+
+                        // set job message to inform clients we are waiting here
+                        job->setMessage("Waiting to aquire a database connection");
+                    }
+                    reconnectAttempts++;
+                    std::this_thread::sleep_for( std::chrono::milliseconds( SERVER_DB_RECONNECT_WAIT ) );
                 }
-                reconnectAttempts++;
-                std::this_thread::sleep_for( std::chrono::milliseconds( SERVER_DB_RECONNECT_WAIT ) );
             }
             job->setMessage("");
 
             switch(job->getType()) {
                 case Job::Type::PULL:
-                    pull(job);
+                    pull(job, **db);
                     break;
                 case Job::Type::REMOVE_BY_ATTRIBUTES:
-                    removeByAttributes(job);
+                    removeByAttributes(job, db);
                     break;
             }
         }
@@ -781,6 +1325,7 @@ Worker::run()
             if (e.hasContext()) {
                 poco_error(logger, "postgresql error context: " + e.getContext());
             }
+            invalidateMetadata(job, e);
             job->setStatus(Job::Status::FAILED);
             job->setMessage(e.what());
         }
@@ -802,212 +1347,3 @@ Worker::run()
     poco_debug(logger, "leaving run method");
 }
 
-
-std::string
-Worker::getPostgresType(OGRFieldType fieldType)
-{
-    std::string pgFieldType;
-
-    switch (fieldType) {
-        case OFTString:
-            pgFieldType = "text";
-            break;
-        case OFTInteger:
-            pgFieldType = "integer";
-            break;
-        case OFTReal:
-            pgFieldType = "double precision";
-            break;
-        case OFTDate:
-            pgFieldType = "date";
-            break;
-        case OFTTime:
-            pgFieldType = "time";
-            break;
-        case OFTDateTime:
-            pgFieldType = "timestamp";
-            break;
-        case OFTIntegerList:
-            pgFieldType = "integer[]";
-            break;
-        case OFTRealList:
-            pgFieldType = "double precision[]";
-            break;
-        case OFTStringList:
-            pgFieldType = "text[]";
-            break;
-        case OFTBinary:
-            pgFieldType = "bytea";
-            break;
-#if GDAL_VERSION_MAJOR > 1
-        case OFTInteger64:
-            pgFieldType = "integer";
-            break;
-        case OFTInteger64List:
-            pgFieldType = "integer[]";
-            break;
-#endif
-        default:
-            throw WorkerError("No supported PostgreSQL type for OGR field type: " + std::to_string(static_cast<int>(fieldType)));
-    }
-    return pgFieldType;
-}
-
-
-QueryValue
-Worker::convertToString(OGRFeature * ogrFeature, const int fieldIdx, OGRFieldType fieldType, const std::string pgTypeName)
-{
-    QueryValue result;
-
-    switch (fieldType) {
-        case OFTString:
-            result.setIsNull(ogrFeature->IsFieldSet(fieldIdx) == 0);
-            if (!result.isNull()) {
-                const char * fieldValue = ogrFeature->GetFieldAsString(fieldIdx);
-                result.set(fieldValue);
-            }
-            break;
-        case OFTInteger:
-#if GDAL_VERSION_MAJOR > 1
-        case OFTInteger64:
-#endif
-            result.setIsNull(ogrFeature->IsFieldSet(fieldIdx) == 0);
-            if (!result.isNull()) {
-                result.set(std::to_string(ogrFeature->GetFieldAsInteger(fieldIdx)));
-            }
-            break;
-        case OFTReal:
-            result.setIsNull(ogrFeature->IsFieldSet(fieldIdx) == 0);
-            if (!result.isNull()) {
-                result.set(std::to_string(ogrFeature->GetFieldAsDouble(fieldIdx)));
-            }
-            break;
-        case OFTDate:
-        case OFTTime:
-        case OFTDateTime:
-            {
-                int dtYear = 0;
-                int dtMonth = 0;
-                int dtDay = 0;
-                int dtHour = 0;
-                int dtMinute = 0;
-                int dtSecond = 0;
-                int dtTZFlag = 0;
-
-                if (ogrFeature->GetFieldAsDateTime(fieldIdx, &dtYear, &dtMonth, &dtDay,
-                            &dtHour, &dtMinute, &dtSecond, &dtTZFlag)) {
-                    char buf[128] = {0,};
-
-                    if (fieldType == OFTDate) {
-                        std::snprintf(buf, sizeof(buf), "%04d-%02d-%02d", dtYear, dtMonth, dtDay);
-                    }
-                    else if (fieldType == OFTTime) {
-                        std::snprintf(buf, sizeof(buf), "%02d:%02d:%09d.0", dtHour, dtMinute, dtSecond);
-                    }
-                    else if (fieldType == OFTDateTime) {
-                        std::snprintf(buf, sizeof(buf), "%04d-%02d-%02dT%02d:%02d:%09d.0",
-                                 dtYear, dtMonth, dtDay, dtHour, dtMinute, dtSecond);
-                    }
-                    else {
-                        throw WorkerError("None of the implemented date/time/datetime types matched. This point should not be reacheable");
-                    }
-                    result.setIsNull(false);
-                    result.set(std::string(buf));
-                }
-                else {
-                    result.setIsNull(true);
-                    if (ogrFeature->IsFieldSet(fieldIdx) == 1) {
-                        poco_debug(logger, "field at index " + std::to_string(fieldIdx) + ""
-                                           " null, but also set.");
-                    }
-                }
-                break;
-            }
-        case OFTIntegerList:
-#if GDAL_VERSION_MAJOR > 1
-        case OFTInteger64List:
-#endif
-        case OFTRealList:
-        case OFTStringList:
-            {
-                std::stringstream valueStream;
-                valueStream << "{";
-                if (fieldType == OFTIntegerList) {
-                    int listLen = 0;
-                    const int *listValues = ogrFeature->GetFieldAsIntegerList(fieldIdx, &listLen);
-                    for (int i=0; i<listLen; i++) {
-                        if (i>0) {
-                            valueStream << ",";
-                        }
-                        valueStream << listValues[i];
-                    }
-                }
-                else if (fieldType == OFTRealList) {
-                    int listLen = 0;
-                    const double *listValues = ogrFeature->GetFieldAsDoubleList(fieldIdx, &listLen);
-                    for (int i=0; i<listLen; i++) {
-                        if (i>0) {
-                            valueStream << ",";
-                        }
-                        valueStream << listValues[i];
-                    }
-                }
-                else if (fieldType == OFTStringList) {
-                    char **listValues = ogrFeature->GetFieldAsStringList(fieldIdx);
-                    int listLen = CSLCount(listValues);
-                    for (int i=0; i<listLen; i++) {
-                        if (i>0) {
-                            valueStream << ",";
-                        }
-                        std::string currentValue(listValues[i]);
-
-                        // escape backslash and quotes in the string with a backslash to 
-                        // build a valid array
-                        // TODO: Escape using postgresqls quite_literal? Will issue lots of queries
-                        StringUtils::replaceAll(currentValue, "\\", "\\\\");
-                        StringUtils::replaceAll(currentValue, "\"", "\\\"");
-
-                        valueStream << "\"" << currentValue << "\"";
-                    }
-                }
-                else {
-                    throw WorkerError("None of the implemented list types matched. This point should not be reacheable");
-                }
-
-                valueStream << "}";
-
-                result.setIsNull(false);
-                result.set(valueStream.str());
-            }
-        case OFTBinary:
-        default:
-            throw WorkerError("Unsupported OGR field type to convert to string: " + std::to_string(static_cast<int>(fieldType)));
-    }
-
-    // sanitize invalid values - empty time types are generaly invalid and most certainly result from
-    // string fields returned as empty strings
-    if (!result.isNull() && result.get().empty() && (
-                (pgTypeName == "timestamp") ||
-                (pgTypeName == "timestampz") ||
-                (pgTypeName == "time") ||
-                (pgTypeName == "date")
-            )) {
-        result.setIsNull(true);
-    }
-
-    return std::move(result);
-}
-
-QueryValue
-Worker::convertFidToString(OGRFeature * ogrFeature)
-{
-    QueryValue result;
-
-    // fid is always an integer
-    // http://www.gdal.org/classOGRFeature.html#a45da957be1eb8aa824e3ee9dbfb9604c
-
-    result.setIsNull(false);
-    result.set(std::to_string(ogrFeature->GetFID()));
-
-    return std::move(result);
-}
@@ -6,10 +6,17 @@
 #include <memory>
 #include <utility>
 #include <stdexcept>
+#include <vector>
 
 #include "server/jobstorage.h"
 #include "server/configuration.h"
+#include "server/syncstatements.h"
+#include "server/sourcefingerprint.h"
+#include "server/watermarkcache.h"
 #include "server/db/connection.h"
+#include "server/db/connectionpool.h"
+#include "server/db/metadatacache.h"
+#include "server/db/asyncexecutor.h"
 #include "server/db/queryvalue.h"
 
 #include "ogrsf_frmts.h"
@@ -33,26 +40,76 @@ namespace Batyr
             Poco::Logger & logger;
             Configuration::Ptr configuration;
             std::shared_ptr<JobStorage> jobs;
-            Batyr::Db::Connection db;
+            SourceFingerprintCache::Ptr sourceFingerprints;
+            WatermarkCache::Ptr watermarks;
+            Db::ConnectionPool::Ptr dbPool;
+            Db::MetadataCache::Ptr metadataCache;
 
-            void pull(Job::Ptr job);
-            void removeByAttributes(Job::Ptr job);
+            /** executes remove-by-attributes jobs when set */
+            Db::AsyncExecutor::Ptr asyncExecutor;
+
+            void pull(Job::Ptr job, Db::Connection & db);
+
+            /**
+             * the connection is handed to the asynchronous executor when
+             * the job gets executed by it
+             */
+            void removeByAttributes(Job::Ptr job, Db::PooledConnection::Ptr & db);
 
             /**
-             * convert the field at the given index with the given
-             * OGRFieldType to a postgresql compatible string
+             * drop the cached catalog metadata of the target table of the job
+             * when the error was caused by a change of the structure of a table
              */
-            QueryValue convertToString(OGRFeature * ogrFeature, const int fieldIdx, OGRFieldType fieldType, const std::string pgTypeName);
+            void invalidateMetadata(Job::Ptr job, const Db::DbError & error);
 
             /**
-             * convert the feature's fid to a postgresql compatible string
+             * build the expression selecting the highest value of the
+             * incremental_column formatted as a literal for an OGR attribute
+             * filter. Fails when the column does not exist or has an
+             * unsupported type.
              */
-            QueryValue convertFidToString(OGRFeature * ogrFeature);
+            std::string buildWatermarkExpression(Db::Transaction & transaction, Layer::Ptr layer,
+                        const Db::FieldMap & tableFields, bool & isString);
 
-            std::string getPostgresType(OGRFieldType fieldType);
+            /**
+             * the highest value of the incremental_column in the table using the
+             * expression of buildWatermarkExpression. Returns an empty string when
+             * the table is empty.
+             */
+            std::string queryWatermark(Db::Transaction & transaction, const std::string & expression,
+                        bool isString, const std::string & quotedTable);
+
+            /**
+             * build the attribute filter selecting the features of the source which
+             * changed since the pull which read the watermark
+             */
+            static std::string buildWatermarkFilter(Layer::Ptr layer, const std::string & watermark);
+
+            /**
+             * apply the server settings of the layer to the transaction
+             */
+            void applyServerSettings(Job::Ptr job, Db::Transaction & transaction, Layer::Ptr layer);
+
+            /**
+             * log the query plans of the statements synchronizing the target
+             * table. With analyze every form of a statement is executed using
+             * "explain analyze" and rolled back afterwards. The merge statement
+             * is explained as well when it is given. For the geometry column
+             * the number of rows decided by each case of the geometry comparison
+             * is logged, as well as the size of the unchanged values kept by the
+             * update.
+             */
+            void explainSync(Job::Ptr job, Db::Transaction & transaction, const SyncStatements & syncStatements,
+                        bool analyze, const std::string & mergeStatement,
+                        bool allowFeatureDeletion, const std::string & geometryColumn,
+                        const std::vector<std::string> & updateColumns, const std::string & digestColumn,
+                        const Db::PostGis::VersionTuple & versionPostgis);
 
         public:
-            Worker(Configuration::Ptr _configuration, std::shared_ptr<JobStorage> _jobs);
+            Worker(Configuration::Ptr _configuration, std::shared_ptr<JobStorage> _jobs,
+                        SourceFingerprintCache::Ptr _sourceFingerprints, WatermarkCache::Ptr _watermarks,
+                        Db::ConnectionPool::Ptr _dbPool, Db::MetadataCache::Ptr _metadataCache,
+                        Db::AsyncExecutor::Ptr _asyncExecutor);
 
             /** disable copying */
             Worker(const Worker &) = delete;
@@ -39,6 +39,23 @@ CREATE TABLE africa (
 
 ALTER TABLE test.africa OWNER TO batyr;
 
+--
+-- Name: africa_digest; Type: TABLE; Schema: test; Owner: batyr; Tablespace: 
+--
+
+CREATE TABLE africa_digest (
+    id character varying(4) NOT NULL,
+    code character varying(4),
+    country character varying(35),
+    the_geom public.geometry,
+    row_digest bigint,
+    CONSTRAINT enforce_dims_the_geom CHECK ((public.st_ndims(the_geom) = 2)),
+    CONSTRAINT enforce_srid_the_geom CHECK ((public.st_srid(the_geom) = (0)))
+);
+
+
+ALTER TABLE test.africa_digest OWNER TO batyr;
+
 --
 -- Name: dataset1; Type: TABLE; Schema: test; Owner: batyr; Tablespace: 
 --
@@ -56,6 +73,19 @@ CREATE TABLE dataset1 (
 
 ALTER TABLE test.dataset1 OWNER TO batyr;
 
+--
+-- Name: dataset_incremental; Type: TABLE; Schema: test; Owner: batyr; Tablespace: 
+--
+
+CREATE TABLE dataset_incremental (
+    id integer NOT NULL,
+    title text,
+    last_modified timestamp with time zone
+);
+
+
+ALTER TABLE test.dataset_incremental OWNER TO batyr;
+
 --
 -- Name: dataset1_id_seq; Type: SEQUENCE; Schema: test; Owner: batyr
 --
@@ -92,6 +122,14 @@ ALTER TABLE ONLY dataset1
     ADD CONSTRAINT dataset1_pkey PRIMARY KEY (id);
 
 
+--
+-- Name: dataset_incremental_pkey; Type: CONSTRAINT; Schema: test; Owner: batyr; Tablespace: 
+--
+
+ALTER TABLE ONLY dataset_incremental
+    ADD CONSTRAINT dataset_incremental_pkey PRIMARY KEY (id);
+
+
 --
 -- Name: pk_africa; Type: CONSTRAINT; Schema: test; Owner: batyr; Tablespace: 
 --
@@ -100,6 +138,14 @@ ALTER TABLE ONLY africa
     ADD CONSTRAINT pk_africa PRIMARY KEY (id);
 
 
+--
+-- Name: pk_africa_digest; Type: CONSTRAINT; Schema: test; Owner: batyr; Tablespace: 
+--
+
+ALTER TABLE ONLY africa_digest
+    ADD CONSTRAINT pk_africa_digest PRIMARY KEY (id);
+
+
 --
 -- PostgreSQL database dump complete
 --